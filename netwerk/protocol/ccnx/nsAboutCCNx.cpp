@@ -0,0 +1,161 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsAboutCCNx.h"
+#include "nsICCNxProtocolHandler.h"
+
+#include "nsNetUtil.h"
+#include "nsEscape.h"
+#include "nsStringStream.h"
+#include "nsISupportsPriority.h"
+#include "prprf.h"
+
+NS_IMPL_ISUPPORTS1(nsAboutCCNx, nsIAboutModule)
+
+static void
+AppendRow(nsACString &buffer, const char *label, PRUint64 value) {
+  char *row = PR_smprintf("<tr><th>%s</th><td>%llu</td></tr>\n",
+                          label, value);
+  if (row) {
+    buffer.Append(row);
+    PR_smprintf_free(row);
+  }
+}
+
+NS_IMETHODIMP
+nsAboutCCNx::NewChannel(nsIURI *aURI, nsIChannel **result) {
+  NS_ENSURE_ARG_POINTER(aURI);
+
+  nsresult rv;
+  nsCOMPtr<nsIIOService> ios = do_GetIOService(&rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsIProtocolHandler> handler;
+  rv = ios->GetProtocolHandler("ccnx", getter_AddRefs(handler));
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsICCNxProtocolHandler> ccnx = do_QueryInterface(handler, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCString buffer;
+  buffer.AssignLiteral(
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<head>\n"
+    "<meta http-equiv=\"refresh\" content=\"1\">\n"
+    "<title>Information about CCNx</title>\n"
+    "</head>\n"
+    "<body>\n"
+    "<h1>CCNx</h1>\n"
+    "<table>\n");
+
+  PRUint64 val;
+  PRUint32 val32;
+#define ROW(label, getter)                      \
+  if (NS_SUCCEEDED(ccnx->getter(&val)))         \
+    AppendRow(buffer, label, val);
+  ROW("Interests sent (estimate)", GetEstimatedInterests)
+  ROW("ContentObjects received (estimate)", GetEstimatedContentObjects)
+  ROW("Timeouts", GetTimeouts)
+  ROW("Retransmits", GetRetransmits)
+  ROW("Bytes received", GetBytesReceived)
+  ROW("OnDataAvailable calls", GetDataCallbacks)
+  ROW("Streams opened", GetStreamsOpened)
+  ROW("Connection cache hits", GetConnectionCacheHits)
+  ROW("Content type cache hits", GetContentTypeCacheHits)
+#undef ROW
+  if (NS_SUCCEEDED(ccnx->GetActiveStreams(&val32)))
+    AppendRow(buffer, "Active streams", val32);
+  if (NS_SUCCEEDED(ccnx->GetBufferedBytes(&val32)))
+    AppendRow(buffer, "Bytes buffered", val32);
+  buffer.AppendLiteral("</table>\n");
+
+  PRUint32 count = 0;
+  nsICCNxStreamInfo **streams = nsnull;
+  rv = ccnx->GetStreams(&count, &streams);
+  if (NS_SUCCEEDED(rv) && count) {
+    buffer.AppendLiteral(
+      "<h2>Open streams</h2>\n"
+      "<table>\n"
+      "<tr><th>Name</th><th>Bytes read</th><th>Window</th>"
+      "<th>Buffered</th><th>Priority</th><th>State</th></tr>\n");
+    for (PRUint32 i = 0; i < count; ++i) {
+      nsICCNxStreamInfo *info = streams[i];
+      nsCAutoString name;
+      PRUint64 bytesRead = 0;
+      PRUint32 window = 0, buffered = 0;
+      PRInt32 priority = nsISupportsPriority::PRIORITY_NORMAL;
+      bool suspended = false, throttled = false;
+      info->GetName(name);
+      info->GetBytesRead(&bytesRead);
+      info->GetWindow(&window);
+      info->GetBufferedBytes(&buffered);
+      info->GetPriority(&priority);
+      info->GetSuspended(&suspended);
+      info->GetThrottled(&throttled);
+
+      char *escaped = nsEscapeHTML(name.get());
+      char *row = PR_smprintf(
+        "<tr><td>%s</td><td>%llu</td><td>%u</td><td>%u</td><td>%d</td>"
+        "<td>%s</td></tr>\n",
+        escaped ? escaped : "", bytesRead, window, buffered, priority,
+        suspended ? "suspended" : throttled ? "throttled" : "reading");
+      if (row) {
+        buffer.Append(row);
+        PR_smprintf_free(row);
+      }
+      nsMemory::Free(escaped);
+    }
+    buffer.AppendLiteral("</table>\n");
+  }
+  NS_FREE_XPCOM_ISUPPORTS_POINTER_ARRAY(count, streams);
+
+  buffer.AppendLiteral("</body>\n</html>\n");
+
+  nsCOMPtr<nsIInputStream> stream;
+  rv = NS_NewCStringInputStream(getter_AddRefs(stream), buffer);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_NewInputStreamChannel(result, aURI, stream,
+                                  NS_LITERAL_CSTRING("text/html"),
+                                  NS_LITERAL_CSTRING("utf-8"));
+}
+
+NS_IMETHODIMP
+nsAboutCCNx::GetURIFlags(nsIURI *aURI, PRUint32 *result) {
+  *result = 0;
+  return NS_OK;
+}
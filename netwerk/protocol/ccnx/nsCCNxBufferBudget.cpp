@@ -0,0 +1,215 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxBufferBudget.h"
+#include "nsCCNxTransport.h"
+
+#include "nsISupportsPriority.h"
+#include "nsXPCOM.h"
+#include "pratom.h"
+
+using namespace mozilla;
+
+#if defined(PR_LOGGING)
+extern PRLogModuleInfo* gCCNxLog;
+#endif
+#define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
+
+nsCCNxBufferBudget::nsCCNxBufferBudget(PRUint32 maxBytes)
+    : mLock("nsCCNxBufferBudget.mLock")
+    , mMaxBytes(maxBytes)
+    , mUsedBytes(0) {
+  LOG(("nsCCNxBufferBudget created @%p [max=%u]", this, maxBytes));
+}
+
+PRUint32
+nsCCNxBufferBudget::LimitFor(PRInt32 priority) {
+  // PRIORITY_HIGHEST may fill the whole budget, PRIORITY_LOWEST only half of
+  // it, so that the low priority streams are the first to back off.
+  if (priority < nsISupportsPriority::PRIORITY_HIGHEST)
+    priority = nsISupportsPriority::PRIORITY_HIGHEST;
+  else if (priority > nsISupportsPriority::PRIORITY_LOWEST)
+    priority = nsISupportsPriority::PRIORITY_LOWEST;
+
+  PRUint64 range = nsISupportsPriority::PRIORITY_LOWEST -
+                   nsISupportsPriority::PRIORITY_HIGHEST;
+  PRUint64 rank = priority - nsISupportsPriority::PRIORITY_HIGHEST;
+  return mMaxBytes - PRUint32((PRUint64(mMaxBytes / 2) * rank) / range);
+}
+
+bool
+nsCCNxBufferBudget::Admit(nsCCNxTransport *trans, PRInt32 priority,
+                          PRUint32 buffered) {
+  MutexAutoLock lock(mLock);
+
+  // a stream holding nothing may always pull one segment, so streams which
+  // are sitting on the budget (e.g. suspended ones) can't starve the others
+  if (buffered == 0 || mUsedBytes < LimitFor(priority))
+    return true;
+
+  for (PRUint32 i = 0; i < mWaiters.Length(); ++i) {
+    if (mWaiters[i].mTransport == trans)
+      return false;
+  }
+
+  PRUint32 index = 0;
+  while (index < mWaiters.Length() && mWaiters[index].mPriority <= priority)
+    ++index;
+  Waiter *waiter = mWaiters.InsertElementAt(index);
+  if (!waiter)
+    return true;  // out of memory, don't leave the stream stuck
+  waiter->mTransport = trans;
+  waiter->mPriority = priority;
+
+  LOG(("nsCCNxBufferBudget::Admit throttling transport %p [used=%u prio=%d]",
+       trans, mUsedBytes, priority));
+  return false;
+}
+
+void
+nsCCNxBufferBudget::Withdraw(nsCCNxTransport *trans) {
+  MutexAutoLock lock(mLock);
+  for (PRUint32 i = 0; i < mWaiters.Length(); ++i) {
+    if (mWaiters[i].mTransport == trans) {
+      mWaiters.RemoveElementAt(i);
+      return;
+    }
+  }
+}
+
+void
+nsCCNxBufferBudget::Charge(PRUint32 bytes) {
+  MutexAutoLock lock(mLock);
+  mUsedBytes += bytes;
+}
+
+void
+nsCCNxBufferBudget::Credit(PRUint32 bytes) {
+  nsTArray<Waiter> waiters;
+  {
+    MutexAutoLock lock(mLock);
+    NS_ASSERTION(mUsedBytes >= bytes, "budget underflow");
+    mUsedBytes = (mUsedBytes > bytes) ? mUsedBytes - bytes : 0;
+
+    // wake up everyone whose share has room again; they are sorted by
+    // priority, so the first one that doesn't fit ends the scan.
+    PRUint32 count = 0;
+    while (count < mWaiters.Length() &&
+           mUsedBytes < LimitFor(mWaiters[count].mPriority))
+      ++count;
+    if (count == 0)
+      return;
+    waiters.AppendElements(mWaiters.Elements(), count);
+    mWaiters.RemoveElementsAt(0, count);
+  }
+
+  // called without our lock, the transports take their own
+  for (PRUint32 i = 0; i < waiters.Length(); ++i)
+    waiters[i].mTransport->OnBudgetAvailable();
+}
+
+PRUint32
+nsCCNxBufferBudget::UsedBytes() {
+  MutexAutoLock lock(mLock);
+  return mUsedBytes;
+}
+
+//-----------------------------------------------------------------------------
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(nsCCNxBudgetedSegments, nsIMemory)
+
+nsCCNxBudgetedSegments::nsCCNxBudgetedSegments(nsCCNxBufferBudget *budget,
+                                               nsIMemory *alloc,
+                                               PRUint32 segmentSize)
+    : mBudget(budget)
+    , mAlloc(alloc)
+    , mSegmentSize(segmentSize)
+    , mBytes(0) {
+}
+
+PRUint32
+nsCCNxBudgetedSegments::Bytes() {
+  return PRUint32(PR_ATOMIC_ADD(&mBytes, 0));
+}
+
+NS_IMETHODIMP_(void *)
+nsCCNxBudgetedSegments::Alloc(size_t size) {
+  NS_ASSERTION(size == mSegmentSize, "the pipe asked for another size");
+  void *p = mAlloc ? mAlloc->Alloc(size) : NS_Alloc(size);
+  if (p) {
+    PR_ATOMIC_ADD(&mBytes, PRInt32(mSegmentSize));
+    if (mBudget)
+      mBudget->Charge(mSegmentSize);
+  }
+  return p;
+}
+
+NS_IMETHODIMP_(void *)
+nsCCNxBudgetedSegments::Realloc(void *ptr, size_t newSize) {
+  // pipe segments are never resized
+  NS_NOTREACHED("nsCCNxBudgetedSegments::Realloc");
+  return nsnull;
+}
+
+NS_IMETHODIMP_(void)
+nsCCNxBudgetedSegments::Free(void *ptr) {
+  if (!ptr)
+    return;
+  if (mAlloc)
+    mAlloc->Free(ptr);
+  else
+    NS_Free(ptr);
+  PR_ATOMIC_ADD(&mBytes, -PRInt32(mSegmentSize));
+  // the pipe holds its monitor here; the budget wakes the throttled
+  // transports through events, see nsCCNxTransport::OnBudgetAvailable
+  if (mBudget)
+    mBudget->Credit(mSegmentSize);
+}
+
+NS_IMETHODIMP
+nsCCNxBudgetedSegments::HeapMinimize(bool immediate) {
+  return mAlloc ? mAlloc->HeapMinimize(immediate) : NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxBudgetedSegments::IsLowMemory(bool *result) {
+  if (mAlloc)
+    return mAlloc->IsLowMemory(result);
+  *result = false;
+  return NS_OK;
+}
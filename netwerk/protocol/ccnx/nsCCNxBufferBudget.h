@@ -0,0 +1,135 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxBufferBudget_h__
+#define nsCCNxBufferBudget_h__
+
+#include "nsISupportsImpl.h"
+#include "nsIMemory.h"
+#include "nsAutoPtr.h"
+#include "nsCOMPtr.h"
+#include "nsTArray.h"
+#include "mozilla/Mutex.h"
+
+class nsCCNxTransport;
+
+// Default process-wide limit on bytes buffered by CCNx transports, used
+// unless the network.ccnx.buffer_budget pref (in KB) says otherwise.
+#define CCNX_DEFAULT_BUFFER_BUDGET (4 * 1024 * 1024)
+
+/**
+ * nsCCNxBufferBudget accounts for the bytes every nsCCNxTransport has read
+ * off the network but that were not consumed by the channel yet, counted in
+ * pipe segments by nsCCNxBudgetedSegments. When the budget runs low,
+ * streams stop pulling segments (their Interest window is closed) starting
+ * with the lowest priority ones, and are woken up again in priority order
+ * as the consumers drain their pipes.
+ *
+ * Shared by all transports and owned by the protocol handler, may be used
+ * from any thread.
+ */
+class nsCCNxBufferBudget {
+  typedef mozilla::Mutex Mutex;
+
+public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxBufferBudget)
+
+  nsCCNxBufferBudget(PRUint32 maxBytes);
+
+  // Called by a transport before it pulls another segment. Returns false
+  // when |buffered| bytes already held by a stream of |priority| exceed its
+  // share of the budget; the transport is then remembered and gets
+  // OnBudgetAvailable once there is room again.
+  bool Admit(nsCCNxTransport *trans, PRInt32 priority, PRUint32 buffered);
+
+  // Forget a transport that is closed while waiting for room.
+  void Withdraw(nsCCNxTransport *trans);
+
+  // Account for bytes entering and leaving the transport pipes.
+  void Charge(PRUint32 bytes);
+  void Credit(PRUint32 bytes);
+
+  PRUint32 MaxBytes()  { return mMaxBytes; }
+  PRUint32 UsedBytes();
+
+private:
+  ~nsCCNxBufferBudget() {}
+
+  PRUint32 LimitFor(PRInt32 priority);
+
+  struct Waiter {
+    nsRefPtr<nsCCNxTransport> mTransport;
+    PRInt32                   mPriority;
+  };
+
+  Mutex                             mLock;
+  const PRUint32                    mMaxBytes;
+  PRUint32                          mUsedBytes;
+  // throttled transports, highest priority first
+  nsTArray<Waiter>                  mWaiters;
+};
+
+/**
+ * Segment allocator of the pipe of one transport. The pipe allocates a
+ * segment when the transport writes into it and frees it once the reader
+ * is done with all of it, so the segments held are what the transport has
+ * buffered. They are charged to and credited back to the budget as they
+ * come and go, on whatever thread uses the pipe, and their memory comes
+ * from |alloc| (the recycling allocator of the protocol handler) if given.
+ */
+class nsCCNxBudgetedSegments : public nsIMemory {
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIMEMORY
+
+  nsCCNxBudgetedSegments(nsCCNxBufferBudget *budget, nsIMemory *alloc,
+                         PRUint32 segmentSize);
+
+  // bytes in the segments currently held by the pipe
+  PRUint32 Bytes();
+
+private:
+  ~nsCCNxBudgetedSegments() {}
+
+  nsRefPtr<nsCCNxBufferBudget>      mBudget;
+  nsCOMPtr<nsIMemory>               mAlloc;
+  const PRUint32                    mSegmentSize;
+  PRInt32                           mBytes;
+};
+
+#endif // nsCCNxBufferBudget_h__
@@ -38,6 +38,12 @@
 
 #include "nsCCNxChannel.h"
 #include "nsCCNxCore.h"
+#include "nsCCNxTransport.h"
+#include "nsCCNxURL.h"
+#include "nsCCNxContentType.h"
+#include "nsCCNxProtocolHandler.h"
+#include "nsCCNxTelemetry.h"
+#include "sampler.h"
 
 #include "nsChannelProperties.h"
 #include "nsMimeTypes.h"
@@ -45,17 +51,34 @@
 #include "nsIContentSniffer.h"
 #include "nsIOService.h"
 #include "nsILoadGroup.h"
+#include "nsISocketTransport.h"
 #include "nsIURL.h"
+#include "nsNetUtil.h"
+#include "nsThreadUtils.h"
+#include "mozilla/Mutex.h"
+
+using namespace mozilla;
+
+#if defined(PR_LOGGING)
+extern PRLogModuleInfo* gCCNxLog;
+#endif
+#define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
 
 //#include <ccn/ccn.h>
 #define NS_GENERIC_CONTENT_SNIFFER \
   "@mozilla.org/network/content-sniffer;1"
 
-NS_IMPL_ISUPPORTS4(nsCCNxChannel,
-                   nsIChannel,
-                   nsIRequest,
-                   nsIStreamListener,
-                   nsIRequestObserver)
+// Threadsafe since listeners of a retargeted channel get it passed to
+// OnDataAvailable off the main thread.
+NS_IMPL_THREADSAFE_ISUPPORTS8(nsCCNxChannel,
+                              nsIChannel,
+                              nsIRequest,
+                              nsISupportsPriority,
+                              nsICCNxChannel,
+                              nsITransportEventSink,
+                              nsITimedChannel,
+                              nsIStreamListener,
+                              nsIRequestObserver)
 
 // This class is used to suspend a request across a function scope.
 class ScopedRequestSuspender {
@@ -80,13 +103,134 @@ private:
 #define SUSPEND_PUMP_FOR_SCOPE() \
   ScopedRequestSuspender pump_suspender__(mPump);
 
+//-----------------------------------------------------------------------------
+// nsCCNxDataDeliverer
+//
+// Reads the content stream of a retargeted channel on the delivery target
+// and calls the listener's OnDataAvailable there, while the channel keeps
+// its pump suspended. Once the stream is done the pump is resumed on the
+// main thread, which then reports OnStopRequest as usual.
+
+class nsCCNxDataDeliverer : public nsIInputStreamCallback
+                          , public nsIRunnable {
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIINPUTSTREAMCALLBACK
+  NS_DECL_NSIRUNNABLE
+
+  // |channel| outlives us: it holds us until OnDeliveryDone
+  nsCCNxDataDeliverer(nsCCNxChannel *channel, nsIAsyncInputStream *stream,
+                      nsIEventTarget *target)
+      : mLock("nsCCNxDataDeliverer.mLock")
+      , mChannel(channel)
+      , mStream(stream)
+      , mTarget(target)
+      , mOffset(0)
+      , mStatus(NS_OK)
+      , mSuspendCount(0)
+      , mParked(false) {
+  }
+
+  nsresult Start() {
+    return mStream->AsyncWait(this, 0, 0, mTarget);
+  }
+
+  // called on the main thread by the channel
+  void Suspend() {
+    MutexAutoLock lock(mLock);
+    ++mSuspendCount;
+  }
+
+  void Resume() {
+    {
+      MutexAutoLock lock(mLock);
+      if (mSuspendCount == 0 || --mSuspendCount > 0 || !mParked)
+        return;
+      mParked = false;
+    }
+    if (NS_FAILED(Start()))
+      Finish(NS_ERROR_UNEXPECTED);
+  }
+
+private:
+  void Finish(nsresult status) {
+    // back to the main thread, see Run
+    mStatus = status;
+    NS_DispatchToMainThread(this);
+  }
+
+  Mutex                             mLock;
+  nsCCNxChannel                    *mChannel;
+  nsCOMPtr<nsIAsyncInputStream>     mStream;
+  nsCOMPtr<nsIEventTarget>          mTarget;
+  // only used on mTarget
+  PRUint32                          mOffset;
+  nsresult                          mStatus;
+  // protected by mLock
+  PRUint32                          mSuspendCount;
+  bool                              mParked;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS2(nsCCNxDataDeliverer,
+                              nsIInputStreamCallback,
+                              nsIRunnable)
+
+NS_IMETHODIMP
+nsCCNxDataDeliverer::OnInputStreamReady(nsIAsyncInputStream *aStream) {
+  PRUint32 avail;
+  nsresult rv = mStream->Available(&avail);
+
+  // a closed or failed stream finishes even while suspended, so that a
+  // cancel always gets to OnStopRequest
+  if (NS_SUCCEEDED(rv)) {
+    MutexAutoLock lock(mLock);
+    if (mSuspendCount) {
+      mParked = true;
+      return NS_OK;
+    }
+  }
+
+  if (NS_SUCCEEDED(rv) && avail) {
+    // same clamping as nsInputStreamPump
+    if (PRUint64(mOffset) + avail > PR_UINT32_MAX)
+      avail = PR_UINT32_MAX - mOffset;
+    rv = mChannel->DeliverData(mStream, mOffset, avail);
+    mOffset += avail;
+    if (NS_FAILED(rv)) {
+      Finish(rv);
+      return NS_OK;
+    }
+  }
+
+  if (rv == NS_BASE_STREAM_CLOSED) {
+    Finish(NS_OK);
+    return NS_OK;
+  }
+  if (NS_SUCCEEDED(rv))
+    rv = mStream->AsyncWait(this, 0, 0, mTarget);
+  if (NS_FAILED(rv))
+    Finish(rv);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxDataDeliverer::Run() {
+  mChannel->OnDeliveryDone(mStatus);
+  return NS_OK;
+}
+
 nsCCNxChannel::nsCCNxChannel(nsIURI *aURI)
     : mStatus(NS_OK) 
     , mLoadFlags(LOAD_NORMAL)
+    , mPriority(PRIORITY_NORMAL)
     , mQueriedProgressSink(true)
+    , mStartedRequest(false)
       //    , mSynthProgressEvents(flase)
       //    , mWasOpened(false)
-    , mWaitingOnAsyncRedirect(false) {
+    , mWaitingOnAsyncRedirect(false)
+    , mTimingEnabled(false)
+    , mChannelCreationTimestamp(TimeStamp::Now())
+    , mChannelCreationTime(PR_Now()) {
   SetURI(aURI);
   mContentType.AssignLiteral(UNKNOWN_CONTENT_TYPE);
 }
@@ -121,6 +265,12 @@ nsCCNxChannel::BeginPumpingData() {
   nsCOMPtr<nsIInputStream> stream;
   nsCOMPtr<nsIChannel> channel;
 
+  // with a known type OnStartRequest doesn't wait for data to sniff
+  if (mContentType.EqualsLiteral(UNKNOWN_CONTENT_TYPE) && gCCNxHandler &&
+      gCCNxHandler->ContentTypes() &&
+      gCCNxHandler->ContentTypes()->Lookup(mURI, mContentType))
+    gCCNxHandler->Stats()->Add(nsCCNxStats::CONTENT_TYPE_HITS);
+
   rv = OpenContentStream(true, getter_AddRefs(stream),
                          getter_AddRefs(channel));
 
@@ -149,22 +299,43 @@ nsCCNxChannel::BeginPumpingData() {
 nsresult
 nsCCNxChannel::OpenContentStream(bool async, nsIInputStream **stream,
                                 nsIChannel** channel) {
-  // 
-  if (!async)
-    return NS_ERROR_NOT_IMPLEMENTED;
+  nsresult rv;
+  if (!async) {
+    // blocking consumers read the pipe of a transport directly. the pipe
+    // puts them to sleep on its monitor until the transport thread writes
+    // to it, so nothing waits for ccnd on the caller's thread.
+    nsRefPtr<nsCCNxURL> url;
+    rv = nsCCNxURL::FromURI(mURI, getter_AddRefs(url));
+    if (NS_FAILED(rv))
+      return rv;
 
-  nsCCNxCore *ndncore = new nsCCNxCore();
-  if (!ndncore)
-    return NS_ERROR_OUT_OF_MEMORY;
-  NS_ADDREF(ndncore);
+    nsRefPtr<nsCCNxTransport> trans = new nsCCNxTransport();
+    rv = trans->Init(url);
+    if (NS_FAILED(rv))
+      return rv;
+    trans->SetPriority(mPriority);
+    return trans->OpenInputStream(nsITransport::OPEN_BLOCKING,
+                                  CCNX_SEGMENT_SIZE,
+                                  nsIOService::gDefaultSegmentCount,
+                                  stream);
+  }
 
-  nsresult rv = ndncore->Init(this);
-  if (NS_FAILED(rv)) {
-    NS_RELEASE(ndncore);
+  nsRefPtr<nsCCNxCore> ndncore = new nsCCNxCore();
+  rv = ndncore->Init(this);
+  if (NS_FAILED(rv))
     return rv;
-  }
 
-  *stream = ndncore;
+  ndncore->SetPriority(mPriority);
+  // background loads have no use for status and progress
+  if (!(mLoadFlags & LOAD_BACKGROUND))
+    ndncore->SetEventSink(this, NS_GetCurrentThread());
+  // the pump reads the pipe of the transport itself
+  nsCOMPtr<nsIAsyncInputStream> pipeIn;
+  rv = ndncore->Connect(getter_AddRefs(pipeIn));
+  if (NS_FAILED(rv))
+    return rv;
+  mCore = ndncore;
+  NS_ADDREF(*stream = pipeIn);
   return NS_OK;
 }
 
@@ -196,25 +367,44 @@ nsCCNxChannel::GetStatus(nsresult *status) {
 NS_IMETHODIMP
 nsCCNxChannel::Cancel(nsresult status) {
   NS_ASSERTION(NS_FAILED(status), "shouldn't cancel with a success code");
-  nsresult rv = NS_ERROR_FAILURE;
+
+  // Ignore redundant cancelation
+  if (NS_FAILED(mStatus))
+    return NS_OK;
 
   mStatus = status;
-  if (mTransport) {
-    rv = mTransport->Cancel(status);
-  }
-  return rv;
+
+  // Tear down the transport first so the fetch stops expressing Interests,
+  // then let the pump deliver OnStopRequest.
+  if (mCore)
+    mCore->CloseWithStatus(status);
+  if (mPump)
+    mPump->Cancel(status);
+  return NS_OK;
 }
 
 NS_IMETHODIMP
 nsCCNxChannel::Suspend(void) {
   NS_ENSURE_TRUE(mPump, NS_ERROR_NOT_INITIALIZED);
-  return mPump->Suspend();
+  nsresult rv = mPump->Suspend();
+  // stop pulling segments from the network as well, otherwise the fetch
+  // keeps filling the pipe behind the suspended pump.
+  if (NS_SUCCEEDED(rv) && mCore)
+    mCore->Suspend();
+  if (NS_SUCCEEDED(rv) && mDeliverer)
+    mDeliverer->Suspend();
+  return rv;
 }
 
 NS_IMETHODIMP
 nsCCNxChannel::Resume(void) {
   NS_ENSURE_TRUE(mPump, NS_ERROR_NOT_INITIALIZED);
-  return mPump->Resume();
+  nsresult rv = mPump->Resume();
+  if (NS_SUCCEEDED(rv) && mCore)
+    mCore->Resume();
+  if (NS_SUCCEEDED(rv) && mDeliverer)
+    mDeliverer->Resume();
+  return rv;
 }
 
 NS_IMETHODIMP
@@ -342,8 +532,12 @@ nsCCNxChannel::SetContentLength(PRInt32 aContentLength)
 
 NS_IMETHODIMP
 nsCCNxChannel::Open(nsIInputStream **result) {
-  // OpenInputStream in old API?
-  return NS_ERROR_NOT_IMPLEMENTED;
+  NS_ENSURE_ARG_POINTER(result);
+  NS_ENSURE_TRUE(mURI, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_TRUE(!mPump, NS_ERROR_IN_PROGRESS);
+
+  nsCOMPtr<nsIChannel> channel;
+  return OpenContentStream(false, result, getter_AddRefs(channel));
 }
 
 NS_IMETHODIMP
@@ -351,12 +545,18 @@ nsCCNxChannel::AsyncOpen(nsIStreamListener *listener, nsISupports *ctxt) {
   // AsyncRead in old API?
   nsresult rv;
 
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::AsyncOpen");
+  // the profiler only keeps static strings, so markers can't carry the name
+  SAMPLE_MARKER("CCNx fetch start");
+
   mListener = listener;
   mListenerContext = ctxt;
+  mAsyncOpenTime = TimeStamp::Now();
 
   rv = BeginPumpingData();
   if (NS_FAILED(rv)) {
     mPump = nsnull;
+    mCore = nsnull;
     mListener = nsnull;
     mListenerContext = nsnull;
     mCallbacks = nsnull;
@@ -383,6 +583,229 @@ nsCCNxChannel::GetContentDispositionHeader(nsACString &aHeader)
   return NS_ERROR_NOT_IMPLEMENTED;
 }
 
+//-----------------------------------------------------------------------------
+// nsCCNxChannel::nsISupportsPriority
+
+NS_IMETHODIMP
+nsCCNxChannel::GetPriority(PRInt32 *aPriority) {
+  *aPriority = mPriority;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::SetPriority(PRInt32 aPriority) {
+  mPriority = aPriority;
+  if (mCore)
+    mCore->SetPriority(aPriority);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::AdjustPriority(PRInt32 aDelta) {
+  return SetPriority(mPriority + aDelta);
+}
+
+//-----------------------------------------------------------------------------
+// nsCCNxChannel::nsICCNxChannel
+
+NS_IMETHODIMP
+nsCCNxChannel::RetargetDeliveryTo(nsIEventTarget *aTarget) {
+  NS_ENSURE_ARG_POINTER(aTarget);
+  NS_ENSURE_STATE(NS_IsMainThread());
+  // too late once data started flowing to the listener
+  NS_ENSURE_STATE(!mStartedRequest && !mDeliverer);
+
+  mDeliveryTarget = aTarget;
+  return NS_OK;
+}
+
+nsresult
+nsCCNxChannel::DeliverData(nsIInputStream *stream, PRUint32 offset,
+                           PRUint32 count) {
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::DeliverData");
+  if (gCCNxHandler)
+    gCCNxHandler->Stats()->Add(nsCCNxStats::DATA_CALLBACKS);
+  // on mDeliveryTarget; mListener can't go away before OnDeliveryDone
+  return mListener->OnDataAvailable(this, mListenerContext, stream,
+                                    offset, count);
+}
+
+void
+nsCCNxChannel::OnDeliveryDone(nsresult status) {
+  NS_ASSERTION(NS_IsMainThread(), "wrong thread");
+
+  if (NS_FAILED(status))
+    Cancel(status);
+  mDeliverer = nsnull;
+
+  // the stream is at its end: let the pump finish the request
+  if (mPump)
+    mPump->Resume();
+}
+
+//-----------------------------------------------------------------------------
+// nsCCNxChannel::nsITransportEventSink
+
+NS_IMETHODIMP
+nsCCNxChannel::OnTransportStatus(nsITransport *transport, nsresult status,
+                                 PRUint64 progress, PRUint64 progressMax) {
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::OnTransportStatus");
+  // the transport threads aren't sampled, so mark the phases of the fetch
+  // on the main thread as their events come in
+  if (status == nsISocketTransport::STATUS_CONNECTING_TO)
+    SAMPLE_MARKER("CCNx fetch connecting");
+  else if (status == nsISocketTransport::STATUS_WAITING_FOR)
+    SAMPLE_MARKER("CCNx fetch waiting");
+
+  // from nsBaseChannel; the transport limits how often this is called
+  if (!mPump || NS_FAILED(mStatus) || (mLoadFlags & LOAD_BACKGROUND))
+    return NS_OK;
+
+  SUSPEND_PUMP_FOR_SCOPE();
+
+  // Lazily fetch mProgressSink
+  if (!mProgressSink) {
+    if (mQueriedProgressSink)
+      return NS_OK;
+    NS_QueryNotificationCallbacks(mCallbacks, mLoadGroup, mProgressSink);
+    mQueriedProgressSink = true;
+    if (!mProgressSink)
+      return NS_OK;
+  }
+
+  // "Waiting for <name>..." and the like
+  nsCAutoString spec;
+  if (NS_SUCCEEDED(mURI->GetSpec(spec))) {
+    NS_ConvertUTF8toUTF16 statusArg(spec);
+    mProgressSink->OnStatus(this, mListenerContext, status, statusArg.get());
+  }
+
+  if (progress)
+    mProgressSink->OnProgress(this, mListenerContext, progress, progressMax);
+
+  return NS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// nsCCNxChannel::nsITimedChannel
+
+const nsCCNxTimings &
+nsCCNxChannel::Timings() {
+  if (mCore)
+    mCore->GetTimings(&mTimings);
+  return mTimings;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::SetTimingEnabled(bool enabled) {
+  mTimingEnabled = enabled;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetTimingEnabled(bool *_retval) {
+  *_retval = mTimingEnabled;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetChannelCreation(TimeStamp *_retval) {
+  *_retval = mChannelCreationTimestamp;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetAsyncOpen(TimeStamp *_retval) {
+  *_retval = mAsyncOpenTime;
+  return NS_OK;
+}
+
+// there is no host name to look up, CCNx names are routed as they are
+NS_IMETHODIMP
+nsCCNxChannel::GetDomainLookupStart(TimeStamp *_retval) {
+  *_retval = TimeStamp();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetDomainLookupEnd(TimeStamp *_retval) {
+  *_retval = TimeStamp();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetConnectStart(TimeStamp *_retval) {
+  *_retval = Timings().mConnectStart;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetConnectEnd(TimeStamp *_retval) {
+  *_retval = Timings().mConnectEnd;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetRequestStart(TimeStamp *_retval) {
+  *_retval = Timings().mRequestStart;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetResponseStart(TimeStamp *_retval) {
+  *_retval = Timings().mResponseStart;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetResponseEnd(TimeStamp *_retval) {
+  *_retval = Timings().mResponseEnd;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetCacheReadStart(TimeStamp *_retval) {
+  *_retval = TimeStamp();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxChannel::GetCacheReadEnd(TimeStamp *_retval) {
+  *_retval = TimeStamp();
+  return NS_OK;
+}
+
+// copied from nsHttpChannel
+#define IMPL_TIMING_ATTR(name)                                 \
+NS_IMETHODIMP                                                  \
+nsCCNxChannel::Get##name##Time(PRTime* _retval) {              \
+    if (!mTimingEnabled)                                       \
+        return NS_ERROR_NOT_AVAILABLE;                         \
+    TimeStamp stamp;                                           \
+    Get##name(&stamp);                                         \
+    if (stamp.IsNull()) {                                      \
+        *_retval = 0;                                          \
+        return NS_OK;                                          \
+    }                                                          \
+    *_retval = mChannelCreationTime +                          \
+        (PRTime) ((stamp - mChannelCreationTimestamp).ToSeconds() * 1e6); \
+    return NS_OK;                                              \
+}
+
+IMPL_TIMING_ATTR(ChannelCreation)
+IMPL_TIMING_ATTR(AsyncOpen)
+IMPL_TIMING_ATTR(DomainLookupStart)
+IMPL_TIMING_ATTR(DomainLookupEnd)
+IMPL_TIMING_ATTR(ConnectStart)
+IMPL_TIMING_ATTR(ConnectEnd)
+IMPL_TIMING_ATTR(RequestStart)
+IMPL_TIMING_ATTR(ResponseStart)
+IMPL_TIMING_ATTR(ResponseEnd)
+IMPL_TIMING_ATTR(CacheReadStart)
+IMPL_TIMING_ATTR(CacheReadEnd)
+
+#undef IMPL_TIMING_ATTR
+
 //-----------------------------------------------------------------------------
 // nsCCNxChannel::nsIStreamListener
 
@@ -390,7 +813,10 @@ NS_IMETHODIMP
 nsCCNxChannel::OnDataAvailable(nsIRequest *request, nsISupports *ctxt,
                                nsIInputStream *stream, PRUint32 offset,
                                PRUint32 count) {
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::OnDataAvailable");
   SUSPEND_PUMP_FOR_SCOPE();
+  if (gCCNxHandler)
+    gCCNxHandler->Stats()->Add(nsCCNxStats::DATA_CALLBACKS);
 
   nsresult rv = mListener->OnDataAvailable(this, mListenerContext, stream,
                                            offset, count);
@@ -422,10 +848,22 @@ CallUnknownTypeSniffer(void *aClosure, const PRUint8 *aData, PRUint32 aCount);
 
 NS_IMETHODIMP
 nsCCNxChannel::OnStartRequest(nsIRequest *request, nsISupports *ctxt) {
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::OnStartRequest");
+  SAMPLE_MARKER("CCNx fetch first data");
+
+  // the pump calls us once the first segment is readable
+  if (NS_SUCCEEDED(mStatus))
+    nsCCNxTelemetry::AccumulateTimeDelta(nsCCNxTelemetry::TIME_TO_FIRST_BYTE,
+                                         mAsyncOpenTime);
+
   // If our content type is unknown, then use the content type sniffer.  If the
   // sniffer is not available for some reason, then we just keep going as-is.
   if (NS_SUCCEEDED(mStatus) && mContentType.EqualsLiteral(UNKNOWN_CONTENT_TYPE)) {
     mPump->PeekStream(CallUnknownTypeSniffer, static_cast<nsIChannel*>(this));
+    // the next load of this name can skip sniffing
+    if (!mContentType.EqualsLiteral(UNKNOWN_CONTENT_TYPE) && gCCNxHandler &&
+        gCCNxHandler->ContentTypes())
+      gCCNxHandler->ContentTypes()->Remember(mURI, mContentType);
   }
 
   // Now, the general type sniffers. Skip this if we have none.
@@ -434,21 +872,70 @@ nsCCNxChannel::OnStartRequest(nsIRequest *request, nsISupports *ctxt) {
       gIOService->GetContentSniffers().Count() != 0)
     mPump->PeekStream(CallTypeSniffers, static_cast<nsIChannel*>(this));
   */
-  SUSPEND_PUMP_FOR_SCOPE();
+  nsresult rv;
+  {
+    SUSPEND_PUMP_FOR_SCOPE();
+    rv = mListener->OnStartRequest(this, mListenerContext);
+  }
+  mStartedRequest = true;
+
+  // the listener may have asked for delivery elsewhere from OnStartRequest;
+  // take over the stream from the pump until it is done.
+  if (NS_SUCCEEDED(rv) && NS_SUCCEEDED(mStatus) && mDeliveryTarget &&
+      mCore && mCore->Stream()) {
+    mDeliverer = new nsCCNxDataDeliverer(this, mCore->Stream(),
+                                         mDeliveryTarget);
+    mPump->Suspend();
+    if (NS_FAILED(mDeliverer->Start())) {
+      // stay on the main thread
+      mDeliverer = nsnull;
+      mPump->Resume();
+    }
+  }
 
-  return mListener->OnStartRequest(this, mListenerContext);
+  return rv;
 }
 
 NS_IMETHODIMP
 nsCCNxChannel::OnStopRequest(nsIRequest *request, nsISupports *ctxt,
                             nsresult status) {
+  SAMPLE_LABEL("CCNx", "nsCCNxChannel::OnStopRequest");
+  SAMPLE_MARKER("CCNx fetch done");
+
   // If both mStatus and status are failure codes, we keep mStatus as-is since
   // that is consistent with our GetStatus and Cancel methods.
   if (NS_SUCCEEDED(mStatus))
     mStatus = status;
 
+  mOnStopRequestTime = TimeStamp::Now();
+  if (NS_SUCCEEDED(mStatus))
+    nsCCNxTelemetry::AccumulateTimeDelta(nsCCNxTelemetry::LOAD_TIME,
+                                         mAsyncOpenTime, mOnStopRequestTime);
+  Timings();
+  // loads that failed or were canceled early never reached some milestones,
+  // and null TimeStamps can't be compared or subtracted
+  if (!mTimings.mConnectStart.IsNull() && !mTimings.mConnectEnd.IsNull() &&
+      !mTimings.mRequestStart.IsNull() && !mTimings.mResponseStart.IsNull() &&
+      !mTimings.mResponseEnd.IsNull() && !mAsyncOpenTime.IsNull() &&
+      mTimings.mResponseEnd > mAsyncOpenTime) {
+    LOG(("nsCCNxChannel::OnStopRequest [this=%p] connect %.1f ms, "
+         "version %.1f ms, first segment %.1f ms, transfer %.1f ms, "
+         "delivery %.1f ms", this,
+         (mTimings.mConnectEnd - mTimings.mConnectStart).ToMilliseconds(),
+         (mTimings.mRequestStart - mTimings.mConnectEnd).ToMilliseconds(),
+         (mTimings.mResponseStart - mTimings.mRequestStart).ToMilliseconds(),
+         (mTimings.mResponseEnd - mTimings.mResponseStart).ToMilliseconds(),
+         (mOnStopRequestTime - mTimings.mResponseEnd).ToMilliseconds()));
+  }
+
   // Cause IsPending to return false.
   mPump = nsnull;
+  // the transport holds a reference back to us through its event sink
+  if (mCore)
+    mCore->CloseWithStatus(mStatus);
+  mCore = nsnull;
+  mDeliverer = nsnull;
+  mDeliveryTarget = nsnull;
 
   mListener->OnStopRequest(this, mListenerContext, mStatus);
   mListener = nsnull;
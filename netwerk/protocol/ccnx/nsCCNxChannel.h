@@ -54,6 +54,16 @@
 #include "nsIProgressEventSink.h"
 #include "nsIInterfaceRequestor.h"
 #include "nsIStreamListener.h"
+#include "nsITransport.h"
+#include "nsITimedChannel.h"
+#include "mozilla/TimeStamp.h"
+#include "nsCCNxTransport.h"
+#include "nsISupportsPriority.h"
+#include "nsICCNxChannel.h"
+#include "nsIEventTarget.h"
+
+class nsCCNxCore;
+class nsCCNxDataDeliverer;
 
 #define NS_CCNX_CHANNEL_CLASSNAME               \
   "nsCCNxChannel"
@@ -65,12 +75,19 @@
 
 class nsCCNxChannel : public nsIChannel
                     , public nsHashPropertyBag
+                    , public nsISupportsPriority
+                    , public nsICCNxChannel
+                    , public nsITransportEventSink
+                    , public nsITimedChannel
                     , private nsIStreamListener {
 public:
   NS_DECL_ISUPPORTS
   NS_DECL_NSICHANNEL
   NS_DECL_NSIREQUEST
-  //  NS_DECL_NSICCNxCHANNEL
+  NS_DECL_NSISUPPORTSPRIORITY
+  NS_DECL_NSICCNXCHANNEL
+  NS_DECL_NSITRANSPORTEVENTSINK
+  NS_DECL_NSITIMEDCHANNEL
 
   nsCCNxChannel(nsIURI *aURI);
   virtual ~nsCCNxChannel();
@@ -114,8 +131,26 @@ private:
   nsresult OpenContentStream(bool async, nsIInputStream **stream,
                              nsIChannel** channel);
 
+  // Used by nsCCNxDataDeliverer: the first is called on the retarget
+  // thread, the second back on the main thread once the stream is done.
+  nsresult DeliverData(nsIInputStream *stream, PRUint32 offset,
+                       PRUint32 count);
+  void OnDeliveryDone(nsresult status);
+
+  // milestones of the transport, refreshed from mCore while we have it
+  const nsCCNxTimings &Timings();
+
+  friend class nsCCNxDataDeliverer;
+
 private:
   nsRefPtr<nsInputStreamPump>         mPump;
+  // sets up the transport whose pipe mPump reads, and forwards Suspend,
+  // Resume and Cancel to it
+  nsRefPtr<nsCCNxCore>                mCore;
+  // set by RetargetDeliveryTo, OnDataAvailable then runs there through
+  // mDeliverer while mPump stays suspended
+  nsCOMPtr<nsIEventTarget>            mDeliveryTarget;
+  nsRefPtr<nsCCNxDataDeliverer>       mDeliverer;
 
   nsCOMPtr<nsIURI>                    mOriginalURI;
   nsCOMPtr<nsIURI>                    mURI;
@@ -127,13 +162,22 @@ private:
   nsCString                           mContentType;
   nsCString                           mContentCharset;
   nsCOMPtr<nsIIOService>              mIOService;
-  nsCOMPtr<nsIChannel>                mTransport;
   nsresult                            mStatus;
   nsCOMPtr<nsILoadGroup>              mLoadGroup;
   PRUint32                            mLoadFlags;
+  PRInt32                             mPriority;
   bool                                mQueriedProgressSink;
+  bool                                mStartedRequest;
   bool                                mWaitingOnAsyncRedirect;
 
+  // nsITimedChannel
+  bool                                mTimingEnabled;
+  mozilla::TimeStamp                  mChannelCreationTimestamp;
+  PRTime                              mChannelCreationTime;
+  mozilla::TimeStamp                  mAsyncOpenTime;
+  mozilla::TimeStamp                  mOnStopRequestTime;
+  nsCCNxTimings                       mTimings;
+
 protected:
   nsCOMPtr<nsIStreamListener>         mListener;
   nsCOMPtr<nsISupports>               mListenerContext;
@@ -0,0 +1,115 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxContentType.h"
+#include "nsCCNxURL.h"
+
+#include "nsAutoPtr.h"
+#include "nsIMIMEService.h"
+#include "nsMimeTypes.h"
+#include "nsServiceManagerUtils.h"
+#include "nsThreadUtils.h"
+#include "prlog.h"
+
+#if defined(PR_LOGGING)
+extern PRLogModuleInfo* gCCNxLog;
+#endif
+#define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
+
+nsCCNxContentTypeCache::nsCCNxContentTypeCache() {
+  mTypes.Init(CCNX_CONTENT_TYPE_CACHE_MAX);
+}
+
+bool
+nsCCNxContentTypeCache::Lookup(nsIURI *uri, nsACString &result) {
+  NS_ASSERTION(NS_IsMainThread(), "wrong thread");
+
+  nsRefPtr<nsCCNxURL> url;
+  nsAutoTArray<PRUint32, 8> prefixes;
+  if (NS_FAILED(nsCCNxURL::FromURI(uri, getter_AddRefs(url))) ||
+      NS_FAILED(url->GetPrefixHashes(prefixes)))
+    return false;
+
+  nsCString type;
+  if (mTypes.Get(prefixes[0], &type)) {
+    result = type;
+    return true;
+  }
+
+  // e.g. ccnx:/parc.com/index.html
+  nsCAutoString ext;
+  nsCOMPtr<nsIMIMEService> mime = do_GetService("@mozilla.org/mime;1");
+  if (NS_SUCCEEDED(url->GetFileExtension(ext)) && !ext.IsEmpty() && mime &&
+      NS_SUCCEEDED(mime->GetTypeFromExtension(ext, type)) &&
+      !type.IsEmpty() && !type.EqualsLiteral(APPLICATION_OCTET_STREAM)) {
+    LOG(("nsCCNxContentTypeCache: %p is %s by its name", uri, type.get()));
+    result = type;
+    return true;
+  }
+
+  // e.g. the frames of ccnx:/parc.com/video/ once one was sniffed. ccnx:/
+  // itself, the last entry, is never remembered.
+  for (PRUint32 i = 1; i + 1 < prefixes.Length(); ++i) {
+    if (mTypes.Get(prefixes[i], &type)) {
+      LOG(("nsCCNxContentTypeCache: %p is %s by its prefix %u up",
+           uri, type.get(), i));
+      result = type;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+nsCCNxContentTypeCache::Remember(nsIURI *uri, const nsACString &type) {
+  NS_ASSERTION(NS_IsMainThread(), "wrong thread");
+
+  nsRefPtr<nsCCNxURL> url;
+  nsAutoTArray<PRUint32, 8> prefixes;
+  if (NS_FAILED(nsCCNxURL::FromURI(uri, getter_AddRefs(url))) ||
+      NS_FAILED(url->GetPrefixHashes(prefixes)) || prefixes.Length() < 2)
+    return;
+
+  // no need for anything smarter than starting over once in a while
+  if (mTypes.Count() + 2 > CCNX_CONTENT_TYPE_CACHE_MAX)
+    mTypes.Clear();
+  mTypes.Put(prefixes[0], nsCString(type));
+  // the latest type found below a prefix wins
+  if (prefixes.Length() > 2)
+    mTypes.Put(prefixes[1], nsCString(type));
+}
@@ -0,0 +1,77 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxContentType_h__
+#define nsCCNxContentType_h__
+
+#include "nsString.h"
+#include "nsDataHashtable.h"
+#include "nsHashKeys.h"
+
+class nsIURI;
+
+// Number of names and name prefixes whose content type is remembered.
+#define CCNX_CONTENT_TYPE_CACHE_MAX 256
+
+/**
+ * Content types of CCNx names, so that a channel knows its type before any
+ * data arrives and doesn't have to hold OnStartRequest back for sniffing.
+ * What sniffing found on a load is remembered for the name and for the
+ * prefix it was published under, i.e. the name without its last component
+ * (ccn_fetch adds the version and segment components, they are never part
+ * of the URL). The type of a name is then, in this order, the one found
+ * for exactly that name, the one of the file extension of its last
+ * component, or the one remembered for its longest known prefix. The
+ * table is keyed by nsCCNxURL::GetPrefixHashes. Owned by the protocol
+ * handler, main thread only.
+ */
+class nsCCNxContentTypeCache {
+public:
+  nsCCNxContentTypeCache();
+
+  // Sets |result| and returns true if the type of |uri| is known.
+  bool Lookup(nsIURI *uri, nsACString &result);
+
+  // Called with the type sniffing found for |uri|.
+  void Remember(nsIURI *uri, const nsACString &type);
+
+private:
+  nsDataHashtable<nsUint32HashKey, nsCString> mTypes;
+};
+
+#endif // nsCCNxContentType_h__
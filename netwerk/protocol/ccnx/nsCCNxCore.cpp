@@ -1,140 +1,125 @@
 #include "nsCCNxCore.h"
 #include "nsCCNxChannel.h"
 #include "nsCCNxTransport.h"
+#include "nsCCNxURL.h"
 
 #include "nsIOService.h"
-#include "nsIURL.h"
-#include "nsStreamUtils.h"
+#include "nsISupportsPriority.h"
+
+using namespace mozilla;
 
 #if defined(PR_LOGGING)
 extern PRLogModuleInfo* gCCNxLog;
 #endif
 #define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
 
-// nsBaseContentStream::nsISupports
-
-NS_IMPL_THREADSAFE_ADDREF(nsCCNxCore)
-NS_IMPL_THREADSAFE_RELEASE(nsCCNxCore)
-
-// We only support nsIAsyncInputStream when we are in non-blocking mode.
-NS_INTERFACE_MAP_BEGIN(nsCCNxCore)
-  NS_INTERFACE_MAP_ENTRY(nsIInputStream)
-  NS_INTERFACE_MAP_ENTRY(nsIInputStreamCallback)
-  NS_INTERFACE_MAP_ENTRY_CONDITIONAL(nsIAsyncInputStream, mNonBlocking)
-  NS_INTERFACE_MAP_ENTRY_AMBIGUOUS(nsISupports, nsIInputStream)
-NS_INTERFACE_MAP_END_THREADSAFE;
-
 nsCCNxCore::nsCCNxCore()
-    : mChannel(nsnull)
-    , mDataTransport(nsnull)
+    : mDataTransport(nsnull)
     , mDataStream(nsnull)
     , mState(CCNX_INIT)
     , mStatus(NS_OK)
-    , mNonBlocking(true)
-    , mCallback(nsnull)
-    , mCallbackTarget(nsnull) {
+    , mSuspendCount(0)
+    , mPriority(nsISupportsPriority::PRIORITY_NORMAL) {
   LOG(("nsCCNxCore created @%p", this));
 }
 
 nsCCNxCore::~nsCCNxCore() {
-  /*
-  if (mDataTransport != nsnull)
-    NS_RELEASE(mDataTransport);
-  mDataTransport = nsnull;
-  */
   mDataTransport = nsnull;
   LOG(("nsCCNxCore destroyed @%p", this));
 }
 
 nsresult
 nsCCNxCore::Init(nsCCNxChannel *channel) {
-  mChannel = channel;
-
-  //  nsCOMPtr<nsIURL> url, URL should be parsed here
-  //  URI can be access by mChannel->URI()
-
-  nsresult rv;
-  nsCOMPtr<nsIURL> url = do_QueryInterface(mChannel->URI());
-  rv = url->GetAsciiSpec(mInterest);
-  // XXX temopry walkaround when nsCCNxURL is absent
-  mInterest.Trim("ccnx:", true, false, false);
-  if (NS_FAILED(rv))
-    return rv;
-
-  return NS_OK;
+  return nsCCNxURL::FromURI(channel->URI(), getter_AddRefs(mURL));
 }
 
-//-----------------------------------------------------------------------------
+void
+nsCCNxCore::Suspend() {
+  ++mSuspendCount;
+  if (mDataTransport)
+    mDataTransport->Suspend();
+}
 
 void
-nsCCNxCore::DispatchCallback(bool async)
-{
-  if (!mCallback)
+nsCCNxCore::Resume() {
+  NS_ASSERTION(mSuspendCount > 0, "unbalanced Resume");
+  if (mSuspendCount == 0)
     return;
+  --mSuspendCount;
+  if (mDataTransport)
+    mDataTransport->Resume();
+}
 
-  // It's important to clear mCallback and mCallbackTarget up-front because the
-  // OnInputStreamReady implementation may call our AsyncWait method.
-  nsCOMPtr<nsIInputStreamCallback> callback;
-  if (async) {
-    NS_NewInputStreamReadyEvent(getter_AddRefs(callback), mCallback,
-                                mCallbackTarget);
-    if (!callback)
-      return;  // out of memory!
-    mCallback = nsnull;
-  }
-  else {
-    callback.swap(mCallback);
-  }
-  mCallbackTarget = nsnull;
-
-  callback->OnInputStreamReady(this);
+void
+nsCCNxCore::SetPriority(PRInt32 priority) {
+  mPriority = priority;
+  if (mDataTransport)
+    mDataTransport->SetPriority(priority);
 }
 
 void
-nsCCNxCore::OnCallbackPending() {
-    // If this is the first call, then see if we could use the cache.  If we
-    // aren't going to read from (or write to) the cache, then just proceed to
-    // connect to the server.
-    if (mState == CCNX_INIT) {
-      // internally call OpenInputStream and refer it as mDataStream
-      // mDataStream is actually created by NS_NewPipe2
-      mState = Connect();
-    }
-    if (mState == CCNX_CONNECT && mDataStream) {
-      // this is a nsPipeOutputStream
-      mDataStream->AsyncWait(this, 0, 0, CallbackTarget());
-    }
+nsCCNxCore::GetTimings(nsCCNxTimings *result) {
+  if (mDataTransport)
+    mDataTransport->GetTimings(result);
+  else
+    *result = mTimings;
 }
 
+//-----------------------------------------------------------------------------
+
+nsresult
+nsCCNxCore::Connect(nsIAsyncInputStream **result) {
+  NS_ENSURE_TRUE(mState == CCNX_INIT, NS_ERROR_IN_PROGRESS);
+  mState = CCNX_ERROR;
 
-CCNX_STATE
-nsCCNxCore::Connect() {
   // create the CCNx transport
-  nsCOMPtr<nsITransport> ntrans;
+  nsRefPtr<nsCCNxTransport> ntrans;
   nsresult rv;
   rv = CreateTransport(getter_AddRefs(ntrans));
   if (NS_FAILED(rv))
-    return CCNX_ERROR;
-  mDataTransport = ntrans;
-  // we are reading from the ndn
+    return rv;
+  ntrans->SetPriority(mPriority);
+  // the channel may have been suspended before we got here
+  for (PRUint32 i = 0; i < mSuspendCount; ++i)
+    ntrans->Suspend();
+  // we are reading from the ndn. the pipe notifies its reader on the
+  // thread of its callback target by itself, and hands the segments the
+  // reader is done with back to the buffer budget.
   nsCOMPtr<nsIInputStream> input;
-  rv = mDataTransport->OpenInputStream(0,
-                                       nsIOService::gDefaultSegmentSize,
-                                       nsIOService::gDefaultSegmentCount,
-                                       getter_AddRefs(input));
-  NS_ENSURE_SUCCESS(rv, CCNX_ERROR);
+  rv = ntrans->OpenInputStream(0,
+                               CCNX_SEGMENT_SIZE,
+                               nsIOService::gDefaultSegmentCount,
+                               getter_AddRefs(input));
+  if (NS_FAILED(rv)) {
+    ntrans->Close(rv);
+    return rv;
+  }
+
+  mDataTransport = ntrans;
   mDataStream = do_QueryInterface(input);
-  return CCNX_CONNECT;
+  mState = CCNX_CONNECT;
+  NS_ADDREF(*result = mDataStream);
+  return NS_OK;
 }
 
 NS_IMETHODIMP
-nsCCNxCore::CreateTransport(nsITransport **result) {
+nsCCNxCore::CreateTransport(nsCCNxTransport **result) {
   nsCCNxTransport *ntrans = new nsCCNxTransport();
   if (!ntrans)
     return NS_ERROR_OUT_OF_MEMORY;
   NS_ADDREF(ntrans);
 
-  nsresult rv = ntrans->Init(mInterest.get());
+  // before Init, so that the sink hears about the connection to ccnd
+  nsresult rv;
+  if (mEventSink) {
+    rv = ntrans->SetEventSink(mEventSink, mEventTarget);
+    if (NS_FAILED(rv)) {
+      NS_RELEASE(ntrans);
+      return rv;
+    }
+  }
+
+  rv = ntrans->Init(mURL);
   if (NS_FAILED(rv)) {
     NS_RELEASE(ntrans);
     return rv;
@@ -144,118 +129,20 @@ nsCCNxCore::CreateTransport(nsITransport **result) {
   return NS_OK;
 }
 
-//-----------------------------------------------------------------------------
-// nsIInputStream Methods
-
-NS_IMETHODIMP
-nsCCNxCore::Close() {
-  return IsClosed() ? NS_OK : CloseWithStatus(NS_BASE_STREAM_CLOSED);
-}
-
-NS_IMETHODIMP
-nsCCNxCore::Available(PRUint32 *avail) {
-  // from nsFtpState
-  if (mDataStream)
-    return mDataStream->Available(avail);
-
-  // from nsBaseContentStream
-  *avail = 0;
-  return mStatus;
-}
-
-NS_IMETHODIMP
-nsCCNxCore::Read(char *buf, PRUint32 count, PRUint32 *countRead) {
-  return ReadSegments(NS_CopySegmentToBuffer, buf, count, countRead);
-}
-
-NS_IMETHODIMP
-nsCCNxCore::ReadSegments(nsWriteSegmentFun writer, void *closure,
-                         PRUint32 count, PRUint32 *countRead) {
-
-  // from nsFtpState
-  if (mDataStream) {
-    nsWriteSegmentThunk thunk = { this, writer, closure };
-    return mDataStream->ReadSegments(NS_WriteSegmentThunk, &thunk,
-                                     count, countRead);
-  }
-
-  // from nsBaseContentStream
-  *countRead = 0;
-
-  if (mStatus == NS_BASE_STREAM_CLOSED)
-    return NS_OK;
-
-  // No data yet
-  if (!IsClosed() && IsNonBlocking())
-    return NS_BASE_STREAM_WOULD_BLOCK;
-
-  return mStatus;
-}
-
-NS_IMETHODIMP
-nsCCNxCore::IsNonBlocking(bool *nonblocking) {
-  *nonblocking = true;
-  return NS_OK;
-}
-
-//-----------------------------------------------------------------------------
-// nsIAsyncInputStream Methods
-
-NS_IMETHODIMP
+void
 nsCCNxCore::CloseWithStatus(nsresult reason) {
-  // from nsFtpState
-
-  if (mDataTransport) {
-    // Shutdown the data transport.
-    mDataTransport->Close(NS_ERROR_ABORT);
-    mDataTransport = nsnull;
-  }
-
-  mDataStream = nsnull;
-
-  // from nsBaseContentStream
   if (IsClosed())
-    return NS_OK;
-
-  NS_ENSURE_ARG(NS_FAILED(reason));
-  mStatus = reason;
-
-  DispatchCallbackAsync();
-  return NS_OK;
-}
-
-NS_IMETHODIMP
-nsCCNxCore::AsyncWait(nsIInputStreamCallback *callback,
-                      PRUint32 flags,
-                      PRUint32 amount,
-                      nsIEventTarget *target) {
-  // Our _only_ consumer is nsInputStreamPump, so we simplify things here by
-  // making assumptions about how we will be called.
-  mCallback = callback;
-  mCallbackTarget = target;
-
-  if (!mCallback)
-    return NS_OK;
-
-  if (IsClosed()) {
-    DispatchCallbackAsync();
-    return NS_OK;
-  }
-
-  OnCallbackPending();
-  return NS_OK;
-}
-
-//-----------------------------------------------------------------------------
-// nsIInputStreamCallback Methods
+    return;
+  mStatus = NS_FAILED(reason) ? reason : NS_BASE_STREAM_CLOSED;
 
-NS_IMETHODIMP
-nsCCNxCore::OnInputStreamReady(nsIAsyncInputStream *aInStream) {
-    // We are receiving a notification from our data stream, so just forward it
-    // on to our stream callback.
-  if (HasPendingCallback())
-    DispatchCallbackSync();
+  nsRefPtr<nsCCNxTransport> trans;
+  trans.swap(mDataTransport);
+  mDataStream = nsnull;
+  if (!trans)
+    return;
 
-  return NS_OK;
+  trans->GetTimings(&mTimings);
+  // Shutdown the data transport, this withdraws the pending Interests. The
+  // reader of the pipe finds out about |reason| from the pipe.
+  trans->Close(NS_FAILED(reason) ? reason : NS_ERROR_ABORT);
 }
-
@@ -7,9 +7,10 @@
 #include "nsIAsyncInputStream.h"
 #include "nsIEventTarget.h"
 #include "nsITransport.h"
+#include "nsCCNxTransport.h"
 
 class nsCCNxChannel;
-class nsCCNxTransport;
+class nsCCNxURL;
 
 typedef enum _CCNX_STATE {
   CCNX_INIT,
@@ -19,51 +20,68 @@ typedef enum _CCNX_STATE {
 
 } CCNX_STATE;
 
-class nsCCNxCore : public nsIAsyncInputStream,
-                  public nsIInputStreamCallback {
+// Connects a channel to its transport. The channel's pump, or the
+// nsCCNxDataDeliverer of a retargeted channel, reads the pipe of the
+// transport directly; nsCCNxCore only sets the transport up and passes on
+// what the channel asks of it. Main thread only.
+class nsCCNxCore {
 public:
-  NS_DECL_ISUPPORTS
-  NS_DECL_NSIINPUTSTREAMCALLBACK
-  NS_DECL_NSIINPUTSTREAM
-  NS_DECL_NSIASYNCINPUTSTREAM
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxCore)
 
   nsCCNxCore();
 
   nsresult Status() { return mStatus; }
-  bool IsNonBlocking() { return mNonBlocking; }
   bool IsClosed() { return NS_FAILED(mStatus); }
 
-  // Called to test if the stream has a pending callback.
-  bool HasPendingCallback() { return mCallback != nsnull; }
+  nsresult Init(nsCCNxChannel *channel);
 
-  // The current dispatch target (may be null) for the pending callback if any.
-  nsIEventTarget *CallbackTarget() { return mCallbackTarget; }
+  // Creates the transport, which starts fetching, and returns the read end
+  // of its pipe. The event sink, the priority and the suspensions set so
+  // far are handed to the transport.
+  nsresult Connect(nsIAsyncInputStream **result);
 
-  nsresult Init(nsCCNxChannel *channel);
-  void DispatchCallback(bool async);
-  void DispatchCallbackAsync() { DispatchCallback(true); }
-  void DispatchCallbackSync() { DispatchCallback(false); }
+  // The pipe returned by Connect, null before and after the transport.
+  nsIAsyncInputStream *Stream() { return mDataStream; }
+
+  // Shuts the transport down, which withdraws the pending Interests and
+  // closes the pipe with |reason|.
+  void CloseWithStatus(nsresult reason);
+
+  // Called by the channel on the main thread. Suspending closes the Interest
+  // window of the underlying transport so no more segments are fetched.
+  void Suspend();
+  void Resume();
 
-protected:
-  virtual ~nsCCNxCore();
+  // Priority used by the buffer budget, see nsISupportsPriority.
+  void SetPriority(PRInt32 priority);
+
+  // Milestones of the transport, kept after it is closed.
+  void GetTimings(nsCCNxTimings *result);
+
+  // Event sink handed to the transport once it is created, see
+  // nsITransport::SetEventSink.
+  void SetEventSink(nsITransportEventSink *sink, nsIEventTarget *target) {
+    mEventSink = sink;
+    mEventTarget = target;
+  }
 
 private:
-  // Called from the base stream(nsCCNxCore)'s AsyncWait method when a pending
-  // callback is installed on the stream.
-  void OnCallbackPending();
-  CCNX_STATE Connect();
-  NS_IMETHODIMP CreateTransport(nsITransport **result);
+  ~nsCCNxCore();
+
+  NS_IMETHODIMP CreateTransport(nsCCNxTransport **result);
 
 private:
-  nsRefPtr<nsCCNxChannel>             mChannel;
-  nsCString                           mInterest;
-  nsCOMPtr<nsITransport>              mDataTransport;
+  nsRefPtr<nsCCNxURL>                 mURL;
+  nsRefPtr<nsCCNxTransport>           mDataTransport;
   nsCOMPtr<nsIAsyncInputStream>       mDataStream;
   CCNX_STATE                          mState;
   nsresult                            mStatus;
-  bool                                mNonBlocking;
-  nsCOMPtr<nsIInputStreamCallback>    mCallback;
-  nsCOMPtr<nsIEventTarget>            mCallbackTarget;
+  PRUint32                            mSuspendCount;
+  PRInt32                             mPriority;
+  nsCOMPtr<nsITransportEventSink>     mEventSink;
+  nsCOMPtr<nsIEventTarget>            mEventTarget;
+  // milestones of the transport once it is closed
+  nsCCNxTimings                       mTimings;
 };
 
 #endif // nsCCNxCore_h__
@@ -0,0 +1,728 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxFetchState.h"
+#include "nsCCNxTransport.h"
+#include "nsCCNxError.h"
+#include "nsCCNxInterestTemplate.h"
+
+#include "nsAlgorithm.h"
+#include "nsThreadUtils.h"
+#include "sampler.h"
+#include "prlog.h"
+#include "prthread.h"
+
+extern "C" {
+#include <ccn/indexbuf.h>
+}
+
+using namespace mozilla;
+
+#if defined(PR_LOGGING)
+extern PRLogModuleInfo* gCCNxLog;
+#endif
+#define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
+
+// Interests asking ccnd for the latest version of a name are sent this many
+// times before the load fails, when nothing answers.
+#define CCNX_RESOLVE_ATTEMPTS 3
+
+// InterestLifetime in ms of the Interests asking for a version later than
+// the one found. ccnd answers from its store right away if it has one, and
+// the load waits for the last of these to time out, like ccn_fetch_open.
+#define CCNX_RESOLVE_LATER 400
+
+/**
+ * Finds the latest version of the name of a stream the way
+ * ccn_resolve_version does, but from upcalls on the driver thread: an
+ * Interest for the rightmost version, then for one after it until none
+ * comes. The fetch stream is then opened on the versioned name.
+ *
+ * Owned by libccn through mClosure and deleted on CCN_UPCALL_FINAL. Like
+ * the stream, protected by the lock of the connection.
+ */
+struct nsCCNxVersionResolver {
+  struct ccn_closure                mClosure;
+  // null once the stream is closed or opened
+  nsCCNxFetchStream                *mStream;
+  // the name without a version, and the version found so far
+  struct ccn_charbuf               *mPrefix;
+  PRUint32                          mPrefixComps;
+  struct ccn_charbuf               *mVersion;
+  // Interests that timed out before any version was found
+  PRUint32                          mAttempts;
+};
+
+namespace {
+
+void
+OpenFetchLocked(nsCCNxFetchStream *stream, struct ccn_charbuf *name) {
+  // maxBufs bounds the number of Interests libccn pipelines for us. the
+  // version is resolved already; assumeFixed = 0
+  stream->mFetch = ccn_fetch_open(stream->mConn->mFetch, name,
+                                  stream->mURI.get(), stream->mTmpl,
+                                  stream->mWindow, 0, 0);
+  if (!stream->mFetch) {
+    LOG(("nsCCNxFetchStatePool can't open %s", stream->mURI.get()));
+    stream->mStatus = NS_ERROR_CCNX_STREAM_UNAVAIL;
+    return;
+  }
+  stream->mOpened = TimeStamp::Now();
+}
+
+int
+ExpressResolve(struct ccn *h, nsCCNxVersionResolver *r) {
+  // exclude everything up to the version we know, and what comes after the
+  // versions. the lowest version is the marker alone.
+  static const unsigned char lowest[] = { CCN_MARKER_VERSION };
+  bool later = r->mVersion->length > 0;
+  struct ccn_charbuf *tmpl = ccn_charbuf_create();
+  nsCCNxInterestTemplate::AppendResolve(tmpl,
+                                        later ? r->mVersion->buf : lowest,
+                                        later ? r->mVersion->length
+                                              : sizeof(lowest),
+                                        r->mStream->mScope,
+                                        later ? CCNX_RESOLVE_LATER
+                                              : r->mStream->mLifetime);
+  int res = ccn_express_interest(h, r->mPrefix, &r->mClosure, tmpl);
+  ccn_charbuf_destroy(&tmpl);
+  return res;
+}
+
+void
+FinishResolve(nsCCNxVersionResolver *r) {
+  nsCCNxFetchStream *stream = r->mStream;
+  r->mStream = nsnull;
+  stream->mResolver = nsnull;
+  if (r->mVersion->length == 0) {
+    // without a stream Read would report an empty content as if it had
+    // been read
+    LOG(("nsCCNxFetchStatePool no version of %s", stream->mURI.get()));
+    stream->mStatus = NS_ERROR_CCNX_STREAM_UNAVAIL;
+    return;
+  }
+  ccn_name_append(r->mPrefix, r->mVersion->buf, r->mVersion->length);
+  OpenFetchLocked(stream, r->mPrefix);
+}
+
+enum ccn_upcall_res
+ResolveVersion(struct ccn_closure *selfp, enum ccn_upcall_kind kind,
+               struct ccn_upcall_info *info) {
+  // inside ccn_run on the driver thread, with the connection lock held
+  nsCCNxVersionResolver *r = static_cast<nsCCNxVersionResolver*>(selfp->data);
+  switch (kind) {
+  case CCN_UPCALL_FINAL:
+    if (r->mStream)
+      r->mStream->mResolver = nsnull;
+    ccn_charbuf_destroy(&r->mPrefix);
+    ccn_charbuf_destroy(&r->mVersion);
+    delete r;
+    return CCN_UPCALL_RESULT_OK;
+
+  case CCN_UPCALL_CONTENT_UNVERIFIED:
+    return r->mStream ? CCN_UPCALL_RESULT_VERIFY : CCN_UPCALL_RESULT_OK;
+
+  case CCN_UPCALL_CONTENT:
+  case CCN_UPCALL_CONTENT_KEYMISSING: {
+    if (!r->mStream)
+      return CCN_UPCALL_RESULT_OK;
+    const unsigned char *comp;
+    size_t size;
+    if (ccn_name_comp_get(info->content_ccnb, info->content_comps,
+                          r->mPrefixComps, &comp, &size) < 0 ||
+        size < 2 || comp[0] != CCN_MARKER_VERSION) {
+      // not versioned content, go with what we have
+      FinishResolve(r);
+      return CCN_UPCALL_RESULT_OK;
+    }
+    ccn_charbuf_reset(r->mVersion);
+    ccn_charbuf_append(r->mVersion, comp, size);
+    // there may be a later one
+    if (ExpressResolve(info->h, r) < 0)
+      FinishResolve(r);
+    return CCN_UPCALL_RESULT_OK;
+  }
+
+  case CCN_UPCALL_INTEREST_TIMED_OUT:
+    if (!r->mStream)
+      return CCN_UPCALL_RESULT_OK;
+    if (r->mVersion->length == 0 && ++r->mAttempts < CCNX_RESOLVE_ATTEMPTS)
+      return CCN_UPCALL_RESULT_REEXPRESS;
+    FinishResolve(r);
+    return CCN_UPCALL_RESULT_OK;
+
+  default:
+    // CCN_UPCALL_CONTENT_BAD and the like end the lookup
+    if (r->mStream)
+      FinishResolve(r);
+    return CCN_UPCALL_RESULT_OK;
+  }
+}
+
+} // anonymous namespace
+
+nsCCNxFetchStream::nsCCNxFetchStream(nsCCNxFetchState *conn,
+                                     const nsACString &uri,
+                                     PRUint32 window)
+    : mConn(conn)
+    , mURI(uri)
+    , mWindow(window)
+    , mName(ccn_charbuf_create())
+    , mTmpl(ccn_charbuf_create())
+    , mScope(CCNX_SCOPE_ANY)
+    , mLifetime(CCNX_LIFETIME_ANY)
+    , mFetch(nsnull)
+    , mStatus(NS_OK)
+    , mResolver(nsnull)
+    , mWaitStart(0) {
+}
+
+nsCCNxFetchStream::~nsCCNxFetchStream() {
+  NS_ASSERTION(!mFetch && !mResolver, "fetch stream still open");
+  ccn_charbuf_destroy(&mName);
+  ccn_charbuf_destroy(&mTmpl);
+}
+
+nsCCNxFetchStatePool::nsCCNxFetchStatePool(PRUint32 maxIdle,
+                                           PRUint32 maxOpen,
+                                           const nsACString &ccndSocket)
+    : mLock("nsCCNxFetchStatePool.mLock")
+    , mIdle(nsnull)
+    , mIdleCount(0)
+    , mMaxIdle(maxIdle)
+    , mOpenCount(0)
+    , mMaxOpen(maxOpen)
+    , mCCNdSocket(ccndSocket)
+    , mShutdown(false)
+    , mWakeEvent(nsnull) {
+  if (!mCCNdSocket.IsEmpty())
+    LOG(("nsCCNxFetchStatePool using ccnd at %s", mCCNdSocket.get()));
+}
+
+nsCCNxFetchStatePool::~nsCCNxFetchStatePool() {
+  // the driver is gone, whatever it didn't get to is closed here. the
+  // transports are gone too, they hold on to the pool.
+  mOpening.Clear();
+  for (PRUint32 i = 0; i < mClosing.Length(); ++i)
+    CloseStream(mClosing[i].mStream, false);
+  mClosing.Clear();
+  NS_ASSERTION(mActive.IsEmpty(), "fetch state still in use");
+  while (mIdle) {
+    nsCCNxFetchState *state = mIdle;
+    mIdle = state->mNext;
+    Destroy(state);
+  }
+  if (mWakeEvent)
+    PR_DestroyPollableEvent(mWakeEvent);
+}
+
+nsresult
+nsCCNxFetchStatePool::Init() {
+  mWakeEvent = PR_NewPollableEvent();
+  if (!mWakeEvent)
+    return NS_ERROR_OUT_OF_MEMORY;
+  nsCOMPtr<nsIRunnable> event =
+    NS_NewRunnableMethod(this, &nsCCNxFetchStatePool::Drive);
+  nsresult rv = NS_NewThread(getter_AddRefs(mThread), event);
+  if (NS_FAILED(rv)) {
+    MutexAutoLock lock(mLock);
+    mShutdown = true;
+  }
+  return rv;
+}
+
+void
+nsCCNxFetchStatePool::Shutdown() {
+  {
+    MutexAutoLock lock(mLock);
+    if (mShutdown)
+      return;
+    mShutdown = true;
+  }
+  if (!mThread)
+    return;
+  PR_SetPollableEvent(mWakeEvent);
+  mThread->Shutdown();
+  mThread = nsnull;
+}
+
+nsCCNxFetchState *
+nsCCNxFetchStatePool::Get(bool *reused) {
+  if (reused)
+    *reused = false;
+
+  // the driver drops the idle connections ccnd closed, e.g. because it
+  // restarted
+  nsCCNxFetchState *state = TakeIdle();
+  MutexAutoLock lock(mLock);
+  if (state) {
+    state->mUsers = 1;
+    mActive.AppendElement(state);
+    if (reused)
+      *reused = true;
+    return state;
+  }
+
+  if (mOpenCount >= mMaxOpen && !mActive.IsEmpty()) {
+    // out of connections: share the least busy one
+    state = mActive[0];
+    for (PRUint32 i = 1; i < mActive.Length(); ++i) {
+      if (mActive[i]->mUsers < state->mUsers)
+        state = mActive[i];
+    }
+    ++state->mUsers;
+    LOG(("nsCCNxFetchStatePool::Get sharing %p [users=%u]",
+         state, state->mUsers));
+    if (reused)
+      *reused = true;
+    return state;
+  }
+  // the connection counts against the limit while it is being made
+  ++mOpenCount;
+
+  {
+    MutexAutoUnlock unlock(mLock);
+    state = Create(CCNdSocket());
+  }
+
+  if (!state) {
+    --mOpenCount;
+    return nsnull;
+  }
+  state->mUsers = 1;
+  mActive.AppendElement(state);
+  return state;
+}
+
+nsCCNxFetchState *
+nsCCNxFetchStatePool::TakeIdle() {
+  MutexAutoLock lock(mLock);
+  nsCCNxFetchState *state = mIdle;
+  if (state) {
+    mIdle = state->mNext;
+    --mIdleCount;
+    state->mNext = nsnull;
+    LOG(("nsCCNxFetchStatePool::Get reusing %p [idle=%u]",
+         state, mIdleCount));
+  }
+  return state;
+}
+
+nsresult
+nsCCNxFetchStatePool::Open(nsCCNxFetchStream *stream) {
+  {
+    MutexAutoLock lock(mLock);
+    if (mShutdown)
+      return NS_ERROR_NOT_INITIALIZED;
+    mOpening.AppendElement(stream);
+  }
+  PR_SetPollableEvent(mWakeEvent);
+  return NS_OK;
+}
+
+void
+nsCCNxFetchStatePool::Close(nsCCNxFetchStream *stream, bool reuse) {
+  {
+    MutexAutoLock lock(mLock);
+    PendingClose *entry = mClosing.AppendElement();
+    entry->mStream = stream;
+    entry->mReuse = reuse;
+    if (mShutdown)
+      return;
+  }
+  PR_SetPollableEvent(mWakeEvent);
+}
+
+bool
+nsCCNxFetchStatePool::RemoveLocked(nsCCNxFetchState *state, bool reuse) {
+  NS_ASSERTION(state->mUsers > 0, "unbalanced fetch state release");
+  if (--state->mUsers > 0)
+    return false;
+  mActive.RemoveElement(state);
+  if (reuse && mIdleCount < mMaxIdle) {
+    state->mNext = mIdle;
+    mIdle = state;
+    ++mIdleCount;
+    return false;
+  }
+  --mOpenCount;
+  return true;
+}
+
+bool
+nsCCNxFetchStatePool::RemoveIdleLocked(nsCCNxFetchState *state) {
+  for (nsCCNxFetchState **p = &mIdle; *p; p = &(*p)->mNext) {
+    if (*p == state) {
+      *p = state->mNext;
+      --mIdleCount;
+      --mOpenCount;
+      return true;
+    }
+  }
+  return false;
+}
+
+nsCCNxFetchState *
+nsCCNxFetchStatePool::Create(const char *ccndSocket) {
+  struct ccn *ccnx = ccn_create();
+  if (!ccnx)
+    return nsnull;
+  if (ccn_connect(ccnx, ccndSocket) < 0) {
+    ccn_destroy(&ccnx);
+    return nsnull;
+  }
+
+  nsCCNxFetchState *state = new nsCCNxFetchState();
+  state->mCCNx = ccnx;
+  state->mFetch = ccn_fetch_new(ccnx);
+  return state;
+}
+
+void
+nsCCNxFetchStatePool::Destroy(nsCCNxFetchState *state) {
+  // closes what the driver didn't, at shutdown
+  for (PRUint32 i = 0; i < state->mStreams.Length(); ++i)
+    state->mStreams[i]->mFetch = nsnull;
+  state->mFetch = ccn_fetch_destroy(state->mFetch);
+  ccn_destroy(&state->mCCNx);
+  if (state->mPollFD)
+    PR_DestroySocketPollFd(state->mPollFD);
+  delete state;
+}
+
+//-----------------------------------------------------------------------------
+// the driver thread
+
+void
+nsCCNxFetchStatePool::Drive() {
+  PR_SetCurrentThreadName("CCNx Driver");
+  LOG(("nsCCNxFetchStatePool driver started"));
+
+  nsTArray<nsCCNxFetchState*> states;
+  nsTArray<PRPollDesc> polls;
+  nsTArray<nsRefPtr<nsCCNxTransport> > wake;
+  const PRIntervalTime interval =
+    PR_MillisecondsToInterval(CCNX_DRIVE_INTERVAL);
+
+  for (;;) {
+    // every connection of the pool, idle ones too: ccnd closing one of
+    // those is how we learn that it went away
+    states.Clear();
+    {
+      MutexAutoLock lock(mLock);
+      if (mShutdown)
+        break;
+      states.AppendElements(mActive);
+      for (nsCCNxFetchState *state = mIdle; state; state = state->mNext)
+        states.AppendElement(state);
+    }
+
+    // wait for ccnd to send something, for work from the transports, or
+    // for the next timer of libccn
+    polls.SetLength(1);
+    polls[0].fd = mWakeEvent;
+    polls[0].in_flags = PR_POLL_READ;
+    polls[0].out_flags = 0;
+    PRIntervalTime timeout = interval;
+    for (PRUint32 i = 0; i < states.Length(); ++i) {
+      nsCCNxFetchState *state = states[i];
+      if (state->mPollFD) {
+        PRPollDesc *pd = polls.AppendElement();
+        pd->fd = state->mPollFD;
+        pd->in_flags = PR_POLL_READ;
+        pd->out_flags = 0;
+      } else if (state->mReconnectAttempts) {
+        timeout = NS_MIN(timeout, ReconnectDelay(state));
+      }
+    }
+    PRInt32 n = PR_Poll(polls.Elements(), polls.Length(), timeout);
+    if (n > 0) {
+      if (polls[0].out_flags & PR_POLL_READ)
+        PR_WaitForPollableEvent(mWakeEvent);
+      for (PRUint32 i = 0, j = 1; i < states.Length(); ++i) {
+        if (!states[i]->mPollFD)
+          continue;
+        if (polls[j++].out_flags)
+          states[i]->mRunNow = true;
+      }
+    }
+
+    nsTArray<nsRefPtr<nsCCNxFetchStream> > opening;
+    nsTArray<PendingClose> closing;
+    {
+      MutexAutoLock lock(mLock);
+      opening.SwapElements(mOpening);
+      closing.SwapElements(mClosing);
+    }
+    for (PRUint32 i = 0; i < closing.Length(); ++i)
+      CloseStream(closing[i].mStream, closing[i].mReuse);
+    for (PRUint32 i = 0; i < opening.Length(); ++i)
+      OpenStream(opening[i]);
+
+    // closing may have destroyed some
+    states.Clear();
+    {
+      MutexAutoLock lock(mLock);
+      states.AppendElements(mActive);
+      for (nsCCNxFetchState *state = mIdle; state; state = state->mNext)
+        states.AppendElement(state);
+    }
+    PRIntervalTime now = PR_IntervalNow();
+    for (PRUint32 i = 0; i < states.Length(); ++i) {
+      nsCCNxFetchState *state = states[i];
+      if (!state->mRunNow && PRIntervalTime(now - state->mLastRun) < interval)
+        continue;
+      state->mRunNow = false;
+      state->mLastRun = now;
+      if (Run(state, wake))
+        continue;
+      bool idle;
+      {
+        MutexAutoLock lock(mLock);
+        // unless Get took it meanwhile
+        idle = RemoveIdleLocked(state);
+      }
+      if (idle) {
+        LOG(("nsCCNxFetchStatePool dropping dead connection %p", state));
+        Destroy(state);
+      }
+    }
+
+    // outside of any lock: the transports take theirs
+    for (PRUint32 i = 0; i < wake.Length(); ++i)
+      wake[i]->OnFetchReady();
+    wake.Clear();
+  }
+
+  // the transports still waiting hold on to their streams and the other
+  // way round. the readers are gone, so nobody waits anymore.
+  {
+    MutexAutoLock lock(mLock);
+    states.Clear();
+    states.AppendElements(mActive);
+  }
+  for (PRUint32 i = 0; i < states.Length(); ++i) {
+    MutexAutoLock lock(states[i]->mLock);
+    nsTArray<nsRefPtr<nsCCNxFetchStream> > &streams = states[i]->mStreams;
+    for (PRUint32 j = 0; j < streams.Length(); ++j)
+      wake.AppendElement()->swap(streams[j]->mWaiter);
+  }
+  wake.Clear();
+
+  LOG(("nsCCNxFetchStatePool driver stopped"));
+}
+
+void
+nsCCNxFetchStatePool::OpenStream(nsCCNxFetchStream *stream) {
+  nsCCNxFetchState *state = stream->mConn;
+  state->mRunNow = true;
+
+  MutexAutoLock lock(state->mLock);
+  state->mStreams.AppendElement(stream);
+  // give ccnd another chance for a new load
+  if (!state->mConnected &&
+      state->mReconnectAttempts >= CCNX_RECONNECT_ATTEMPTS)
+    state->mReconnectAttempts = 0;
+
+  // like ccn_fetch_open with CCN_V_HIGHEST, look up the latest version,
+  // replacing the one the name may end with
+  nsCCNxVersionResolver *r = new nsCCNxVersionResolver();
+  memset(&r->mClosure, 0, sizeof(r->mClosure));
+  r->mClosure.p = ResolveVersion;
+  r->mClosure.data = r;
+  r->mStream = stream;
+  r->mPrefix = ccn_charbuf_create();
+  r->mVersion = ccn_charbuf_create();
+  r->mAttempts = 0;
+  ccn_charbuf_append_charbuf(r->mPrefix, stream->mName);
+  struct ccn_indexbuf *comps = ccn_indexbuf_create();
+  int n = ccn_name_split(r->mPrefix, comps);
+  const unsigned char *comp;
+  size_t size;
+  if (n > 0 &&
+      ccn_name_comp_get(r->mPrefix->buf, comps, n - 1, &comp, &size) == 0 &&
+      size > 0 && comp[0] == CCN_MARKER_VERSION)
+    n = ccn_name_chop(r->mPrefix, comps, n - 1);
+  ccn_indexbuf_destroy(&comps);
+  r->mPrefixComps = n < 0 ? 0 : PRUint32(n);
+
+  stream->mResolver = r;
+  if (n < 0 || ExpressResolve(state->mCCNx, r) < 0) {
+    // libccn never got the closure
+    stream->mResolver = nsnull;
+    stream->mStatus = NS_ERROR_CCNX_STREAM_UNAVAIL;
+    ccn_charbuf_destroy(&r->mPrefix);
+    ccn_charbuf_destroy(&r->mVersion);
+    delete r;
+  }
+}
+
+void
+nsCCNxFetchStatePool::CloseStream(nsCCNxFetchStream *stream, bool reuse) {
+  nsCCNxFetchState *state = stream->mConn;
+  // released after the connection lock, it may be the last reference
+  nsRefPtr<nsCCNxTransport> waiter;
+  {
+    MutexAutoLock lock(state->mLock);
+    // a lookup still going on finishes on its own, for nobody
+    if (stream->mResolver) {
+      stream->mResolver->mStream = nsnull;
+      stream->mResolver = nsnull;
+    }
+    if (stream->mFetch)
+      stream->mFetch = ccn_fetch_close(stream->mFetch);
+    waiter.swap(stream->mWaiter);
+    state->mStreams.RemoveElement(stream);
+    reuse = reuse && state->mConnected;
+  }
+  state->mRunNow = true;
+
+  bool destroy;
+  {
+    MutexAutoLock lock(mLock);
+    destroy = RemoveLocked(state, reuse);
+  }
+  if (destroy)
+    Destroy(state);
+}
+
+bool
+nsCCNxFetchStatePool::Run(nsCCNxFetchState *state,
+                          nsTArray<nsRefPtr<nsCCNxTransport> > &wake) {
+  MutexAutoLock lock(state->mLock);
+  if (state->mConnected) {
+    SAMPLE_LABEL("CCNx", "ccn_run");
+    if (ccn_run(state->mCCNx, 0) < 0) {
+      // ccnd closed the connection. ccn_fetch keeps the segments it has
+      // and knows which are missing, so once reconnected the streams
+      // carry on from where they stopped.
+      LOG(("nsCCNxFetchStatePool lost the connection %p to ccnd", state));
+      state->mConnected = false;
+      state->mReconnectAttempts = 0;
+      if (state->mPollFD) {
+        PR_DestroySocketPollFd(state->mPollFD);
+        state->mPollFD = nsnull;
+      }
+    } else if (!state->mPollFD) {
+      PollFDLocked(state);
+    }
+  }
+  if (!state->mConnected) {
+    if (state->mStreams.IsEmpty())
+      return false;
+    if (state->mReconnectAttempts < CCNX_RECONNECT_ATTEMPTS &&
+        ReconnectDelay(state) == 0)
+      ReconnectLocked(state);
+  }
+
+  bool progress = false;
+  PRIntervalTime now = PR_IntervalNow();
+  for (PRUint32 i = 0; i < state->mStreams.Length(); ++i) {
+    nsCCNxFetchStream *stream = state->mStreams[i];
+    // data, the end of the content or an error; a reader left waiting
+    // meanwhile also reads again once in a while, since only
+    // ccn_fetch_read tells about Interests that timed out
+    bool ready = NS_FAILED(stream->mStatus) ||
+                 (stream->mFetch && ccn_fetch_avail(stream->mFetch) != 0);
+    if (ready)
+      progress = true;
+    if (stream->mWaiter &&
+        (ready || (stream->mFetch &&
+                   PRIntervalTime(now - stream->mWaitStart) >=
+                   PR_MillisecondsToInterval(CCNX_TIMEOUT_CHECK))))
+      wake.AppendElement()->swap(stream->mWaiter);
+  }
+  // for the readers gathering ContentObjects into a pipe segment
+  if (progress)
+    state->mProgress.NotifyAll();
+  return true;
+}
+
+bool
+nsCCNxFetchStatePool::ReconnectLocked(nsCCNxFetchState *state) {
+  ++state->mReconnectAttempts;
+  state->mLastReconnect = PR_IntervalNow();
+  ccn_disconnect(state->mCCNx);
+  if (ccn_connect(state->mCCNx, CCNdSocket()) < 0) {
+    LOG(("nsCCNxFetchStatePool reconnect attempt %u of %p failed",
+         state->mReconnectAttempts, state));
+    if (state->mReconnectAttempts >= CCNX_RECONNECT_ATTEMPTS) {
+      // until then, a lost connection looks like a slow one
+      for (PRUint32 i = 0; i < state->mStreams.Length(); ++i) {
+        nsCCNxFetchStream *stream = state->mStreams[i];
+        if (NS_SUCCEEDED(stream->mStatus))
+          stream->mStatus = NS_ERROR_CONNECTION_REFUSED;
+      }
+    }
+    return false;
+  }
+
+  LOG(("nsCCNxFetchStatePool reconnected %p to ccnd after %u attempts",
+       state, state->mReconnectAttempts));
+  state->mConnected = true;
+  state->mReconnectAttempts = 0;
+  PollFDLocked(state);
+  // the Interests pending on the old connection are gone with it: let
+  // ccn_fetch express them again for the segments still missing. a
+  // version lookup times out and asks again by itself.
+  for (PRUint32 i = 0; i < state->mStreams.Length(); ++i) {
+    nsCCNxFetchStream *stream = state->mStreams[i];
+    if (stream->mFetch)
+      ccn_reset_timeout(stream->mFetch);
+  }
+  return true;
+}
+
+PRIntervalTime
+nsCCNxFetchStatePool::ReconnectDelay(nsCCNxFetchState *state) {
+  // the first attempt is made at once
+  if (!state->mReconnectAttempts)
+    return 0;
+  PRIntervalTime wait = PR_MillisecondsToInterval(
+    CCNX_RECONNECT_DELAY << (state->mReconnectAttempts - 1));
+  PRIntervalTime elapsed = PR_IntervalNow() - state->mLastReconnect;
+  return elapsed < wait ? wait - elapsed : 0;
+}
+
+void
+nsCCNxFetchStatePool::PollFDLocked(nsCCNxFetchState *state) {
+  if (state->mPollFD)
+    PR_DestroySocketPollFd(state->mPollFD);
+  int fd = ccn_get_connection_fd(state->mCCNx);
+  state->mPollFD = fd >= 0 ? PR_CreateSocketPollFd(fd) : nsnull;
+}
@@ -0,0 +1,283 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxFetchState_h__
+#define nsCCNxFetchState_h__
+
+#include "nsISupportsImpl.h"
+#include "mozilla/CondVar.h"
+#include "mozilla/Mutex.h"
+#include "mozilla/TimeStamp.h"
+#include "nsAutoPtr.h"
+#include "nsCOMPtr.h"
+#include "nsIThread.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "prio.h"
+
+extern "C" {
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/fetch.h>
+}
+
+class nsCCNxTransport;
+struct nsCCNxFetchState;
+struct nsCCNxVersionResolver;
+
+// Number of idle fetch states kept connected to ccnd for reuse.
+#define CCNX_FETCH_POOL_MAX 8
+
+// Number of connections to ccnd open at a time, idle ones included. Beyond
+// it, transports share the connections that are open already, so the number
+// of file descriptors stays bounded however many loads are running.
+#define CCNX_MAX_CONNECTIONS 64
+
+// Longest time in ms the driver thread sleeps between two runs of libccn on
+// a connection, which is what expresses timed out Interests again.
+#define CCNX_DRIVE_INTERVAL 20
+
+// Delay in ms before the second attempt to get back to ccnd after it went
+// away, doubled for every further attempt. The first one is made at once.
+#define CCNX_RECONNECT_DELAY 100
+// Attempts before the streams of the connection fail, about 13 s with the
+// delays above.
+#define CCNX_RECONNECT_ATTEMPTS 8
+
+// How often in ms a reader waiting for data is woken up anyway, so that it
+// sees the Interests of its stream that timed out: libccn only reports those
+// to ccn_fetch_read.
+#define CCNX_TIMEOUT_CHECK 100
+
+/**
+ * A fetch stream on a connection to ccnd, from the Init of its transport to
+ * the close of the stream. The transport reads from it on the transport
+ * threads. The driver thread of nsCCNxFetchStatePool resolves the version
+ * of the name, opens and closes the ccn_fetch stream, and wakes the
+ * transport when a read can make progress.
+ *
+ * The name, template and window are set before the stream is handed to the
+ * driver and don't change afterwards; the rest is protected by the lock of
+ * the connection.
+ */
+class nsCCNxFetchStream {
+public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxFetchStream)
+
+  nsCCNxFetchStream(nsCCNxFetchState *conn, const nsACString &uri,
+                    PRUint32 window);
+  ~nsCCNxFetchStream();
+
+  nsCCNxFetchState *const           mConn;
+  const nsCString                   mURI;
+  const PRUint32                    mWindow;
+  struct ccn_charbuf               *mName;
+  struct ccn_charbuf               *mTmpl;
+  // Scope and InterestLifetime of the version lookup, as in mTmpl
+  PRInt32                           mScope;
+  PRUint32                          mLifetime;
+
+  // null until the driver opened it and after it closed it
+  struct ccn_fetch_stream          *mFetch;
+  // when mFetch was opened, for nsCCNxTimings
+  mozilla::TimeStamp                mOpened;
+  // set once the stream can't be opened or ccnd can't be reached anymore
+  nsresult                          mStatus;
+  // the pending lookup of the latest version of the name, if any
+  nsCCNxVersionResolver            *mResolver;
+  // the transport to wake once reading makes progress again, set by a
+  // reader that found nothing. the driver lets go of it when waking it up.
+  nsRefPtr<nsCCNxTransport>         mWaiter;
+  PRIntervalTime                    mWaitStart;
+};
+
+/**
+ * The libccn state behind the fetch streams of one or more transports: the
+ * ccnd connection and the fetch handle.
+ *
+ * libccn handles are not thread safe, so every call into libccn on it is
+ * made with mLock held. Only the driver thread runs ccn_run, and only ever
+ * as ccn_run(h, 0): the lock is never held while waiting for ccnd. Readers
+ * take it to call ccn_fetch_read, the main thread never does.
+ */
+struct nsCCNxFetchState {
+  nsCCNxFetchState()
+    : mLock("nsCCNxFetchState.mLock")
+    , mProgress(mLock, "nsCCNxFetchState.mProgress")
+    , mCCNx(nsnull)
+    , mFetch(nsnull)
+    , mPollFD(nsnull)
+    , mConnected(true)
+    , mReconnectAttempts(0)
+    , mLastReconnect(0)
+    , mLastRun(0)
+    , mRunNow(false)
+    , mUsers(0)
+    , mNext(nsnull) {}
+
+  mozilla::Mutex                    mLock;
+  // notified by the driver when a run of libccn left data to read
+  mozilla::CondVar                  mProgress;
+  struct ccn                       *mCCNx;
+  struct ccn_fetch                 *mFetch;
+  // the fd of mCCNx for PR_Poll, driver thread only
+  PRFileDesc                       *mPollFD;
+  // the streams the driver opened or is opening, protected by mLock
+  nsTArray<nsRefPtr<nsCCNxFetchStream> > mStreams;
+  // ccnd closed the connection and the driver didn't get it back yet;
+  // protected by mLock
+  bool                              mConnected;
+  // driver thread only
+  PRUint32                          mReconnectAttempts;
+  PRIntervalTime                    mLastReconnect;
+  PRIntervalTime                    mLastRun;
+  // run libccn on it in the current round of the driver
+  bool                              mRunNow;
+  // transports using the state, protected by the lock of the pool
+  PRUint32                          mUsers;
+  nsCCNxFetchState                 *mNext;
+};
+
+/**
+ * Free list of nsCCNxFetchState, owned by the protocol handler. A transport
+ * that finished cleanly gives its state back with its connection still
+ * open, so the next request skips connecting to ccnd and
+ * allocating the handles again. Once CCNX_MAX_CONNECTIONS are open, new
+ * transports share the state with the fewest users instead. Used from any
+ * thread.
+ *
+ * The pool also owns the driver thread, the one thread running libccn for
+ * all connections, in the way of nsSocketTransportService: it polls their
+ * fds, runs ccn_run(h, 0) on the ones with something to read or whose
+ * Interests may have timed out, and wakes the transports whose streams got
+ * data. Opening and closing fetch streams go through it too, so that
+ * neither the main thread nor the readers wait for ccnd.
+ *
+ * Connections go to the ccnd at |ccndSocket| when given, e.g. a fake ccnd
+ * serving canned content for testing, otherwise to the one libccn finds
+ * through CCN_LOCAL_SOCKNAME and CCN_LOCAL_PORT.
+ */
+class nsCCNxFetchStatePool {
+  typedef mozilla::Mutex Mutex;
+
+public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxFetchStatePool)
+
+  nsCCNxFetchStatePool(PRUint32 maxIdle,
+                       PRUint32 maxOpen = CCNX_MAX_CONNECTIONS,
+                       const nsACString &ccndSocket = EmptyCString());
+
+  // Start and stop the driver thread, main thread only. Streams still open
+  // at Shutdown are closed when the pool goes away.
+  nsresult Init();
+  void Shutdown();
+
+  // Returns a state connected to ccnd, taken from the free list or shared
+  // with other transports when possible (then |reused| is set). Returns
+  // null if ccnd can't be reached.
+  nsCCNxFetchState *Get(bool *reused = nsnull);
+
+  // the ccnd socket connections go to, null for libccn's default
+  const char *CCNdSocket() {
+    return mCCNdSocket.IsEmpty() ? nsnull : mCCNdSocket.get();
+  }
+
+  // Has the driver open |stream| on its state, taken from Get. Fails once
+  // the pool is shut down.
+  nsresult Open(nsCCNxFetchStream *stream);
+
+  // Has the driver close |stream| and give back its state. The connection
+  // is kept for the next request if |reuse| is set; otherwise closing the
+  // face is what withdraws the pending Interests, unless other transports
+  // still use it.
+  void Close(nsCCNxFetchStream *stream, bool reuse);
+
+private:
+  ~nsCCNxFetchStatePool();
+
+  struct PendingClose {
+    nsRefPtr<nsCCNxFetchStream>     mStream;
+    bool                            mReuse;
+  };
+
+  // the driver thread
+  void Drive();
+  void OpenStream(nsCCNxFetchStream *stream);
+  void CloseStream(nsCCNxFetchStream *stream, bool reuse);
+  // runs libccn on |state|, or tries to reconnect it, and collects the
+  // transports to wake in |wake|. returns false if it is idle and ccnd
+  // closed it.
+  bool Run(nsCCNxFetchState *state,
+           nsTArray<nsRefPtr<nsCCNxTransport> > &wake);
+  bool ReconnectLocked(nsCCNxFetchState *state);
+  // time left before the next reconnect attempt on |state| is due
+  static PRIntervalTime ReconnectDelay(nsCCNxFetchState *state);
+  void PollFDLocked(nsCCNxFetchState *state);
+
+  // drops a state nobody uses anymore, called with mLock held; returns
+  // true if the caller must destroy it.
+  bool RemoveLocked(nsCCNxFetchState *state, bool reuse);
+  // takes an idle state off the free list; false if it isn't there
+  bool RemoveIdleLocked(nsCCNxFetchState *state);
+
+  nsCCNxFetchState *TakeIdle();
+
+  static nsCCNxFetchState *Create(const char *ccndSocket);
+  static void Destroy(nsCCNxFetchState *state);
+
+  Mutex                             mLock;
+  nsCCNxFetchState                 *mIdle;
+  PRUint32                          mIdleCount;
+  const PRUint32                    mMaxIdle;
+  // states given out, and the number of connections open (in use, idle or
+  // being connected)
+  nsTArray<nsCCNxFetchState*>       mActive;
+  PRUint32                          mOpenCount;
+  const PRUint32                    mMaxOpen;
+  const nsCString                   mCCNdSocket;
+
+  // work for the driver, protected by mLock
+  nsTArray<nsRefPtr<nsCCNxFetchStream> > mOpening;
+  nsTArray<PendingClose>            mClosing;
+  bool                              mShutdown;
+  // wakes the driver up from PR_Poll
+  PRFileDesc                       *mWakeEvent;
+  nsCOMPtr<nsIThread>               mThread;
+};
+
+#endif // nsCCNxFetchState_h__
@@ -38,10 +38,13 @@
 
 #include "mozilla/Mutex.h"
 #include "nsStreamUtils.h"
+#include "nsAlgorithm.h"
 
 #include "nsCCNxInputStream.h"
 #include "nsCCNxTransport.h"
 #include "nsCCNxError.h"
+#include "nsCCNxTrace.h"
+#include "sampler.h"
 
 using namespace mozilla;
 
@@ -49,6 +52,9 @@ using namespace mozilla;
 extern PRLogModuleInfo* gCCNxLog;
 #endif
 #define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
+// per read and refcount noise, only at nsCCNx:5. The trace ring of
+// nsCCNxTrace is the cheaper way to look at the read path.
+#define LOG5(args)        PR_LOG(gCCNxLog, PR_LOG_DEBUG + 1, args)
 
 NS_IMPL_QUERY_INTERFACE2(nsCCNxInputStream,
                          nsIInputStream,
@@ -58,6 +64,8 @@ nsCCNxInputStream::nsCCNxInputStream(nsCCNxTransport* trans)
     : mTransport(trans)
     , mReaderRefCnt(0)
     , mByteCount(0)
+    , mObjectCount(0)
+    , mTimeoutCount(0)
     , mCondition(NS_OK)
     , mCallbackFlags(0) {
   LOG(("create nsCCNxInputStream @%p", this));
@@ -69,7 +77,26 @@ nsCCNxInputStream::~nsCCNxInputStream() {
 
 void
 nsCCNxInputStream::OnCCNxReady(nsresult condition) {
-    // not impletmented yet
+  // minic nsSocketInputStream::OnSocketReady
+  nsCOMPtr<nsIInputStreamCallback> callback;
+  {
+    MutexAutoLock lock(mTransport->mLock);
+
+    // update condition, but be careful not to erase an already
+    // existing error condition.
+    if (NS_SUCCEEDED(mCondition))
+      mCondition = condition;
+
+    // ignore event if only waiting for closure and not closed.
+    if (NS_FAILED(mCondition) || !(mCallbackFlags & WAIT_CLOSURE_ONLY)) {
+      callback = mCallback;
+      mCallback = nsnull;
+      mCallbackFlags = 0;
+    }
+  }
+
+  if (callback)
+    callback->OnInputStreamReady(this);
 }
 
 
@@ -80,7 +107,7 @@ NS_IMETHODIMP_(nsrefcnt)
 nsCCNxInputStream::AddRef()
 {
   NS_AtomicIncrementRefcnt(mReaderRefCnt);
-  LOG(("AddRef nsCCNxInputStream @%p", this));
+  LOG5(("AddRef nsCCNxInputStream @%p", this));
 
   return mTransport->AddRef();
 }
@@ -90,7 +117,7 @@ nsCCNxInputStream::Release()
 {
   if (NS_AtomicDecrementRefcnt(mReaderRefCnt) == 0)
     Close();
-  LOG(("Release nsCCNxInputStream @%p", this));
+  LOG5(("Release nsCCNxInputStream @%p", this));
   return mTransport->Release();
 }
 
@@ -110,60 +137,156 @@ nsCCNxInputStream::Available(PRUint32 *avail) {
 
 NS_IMETHODIMP
 nsCCNxInputStream::Read(char *buf, PRUint32 count, PRUint32 *countRead) {
+  return ReadWithin(buf, count, countRead, 0);
+}
+
+nsresult
+nsCCNxInputStream::ReadWithin(char *buf, PRUint32 count, PRUint32 *countRead,
+                              PRIntervalTime timeout) {
+  SAMPLE_LABEL("CCNx", "nsCCNxInputStream::Read");
   int res;
 
-  //  return NS_ERROR_NOT_IMPLEMENTED;
   *countRead = 0;
 
-  struct ccn_fetch_stream *ccnfs;
+  nsCCNxFetchStream *stream;
   {
     MutexAutoLock lock(mTransport->mLock);
 
-    // TODO: how this works?
     if (NS_FAILED(mCondition))
       return (mCondition == NS_BASE_STREAM_CLOSED) ? NS_OK : mCondition;
 
-    ccnfs = mTransport->CCNX_GetLocked();
-    if (!ccnfs)
+    // the channel is suspended: leave ccn_fetch alone so that no more
+    // Interests go out, and wait for OnCCNxReady to reopen the window.
+    if (mTransport->WindowLocked() == 0)
+      return NS_BASE_STREAM_WOULD_BLOCK;
+
+    // likewise when the process-wide buffer budget is used up; the budget
+    // calls back into the transport when there is room again.
+    if (!mTransport->AdmitLocked())
+      return NS_BASE_STREAM_WOULD_BLOCK;
+
+    stream = mTransport->CCNX_GetLocked();
+    if (!stream)
       return NS_BASE_STREAM_CLOSED;
+    // whatever the driver found is read now
+    mTransport->mReadable = false;
   }
 
   // Actually reading process
-  // ccn_fetch_read is non-blocking, so we have to block it manually
-  // however, the bright side is that we don't need to move ccn_fetch_open
-  // here. It must be non-blocking as well.
-  //  res = ccn_fetch_read(ccnfs, buf, count);
-
-  nsresult rv;
+  // ccn_fetch_read doesn't block and only the driver thread of the pool
+  // runs ccn_run, so this either takes what the driver brought in or asks
+  // it to wake us up once there is more. Other transports may share the
+  // connection: every libccn call is made with its lock held, but never
+  // while waiting for the transport lock.
+  nsCCNxFetchState *conn = stream->mConn;
+  nsresult status;
+  TimeStamp opened;
+  PRUint32 timeouts = 0;
+  PRIntervalTime start = PR_IntervalNow();
+  res = CCN_FETCH_READ_NONE;
   {
-    MutexAutoLock lock(mTransport->mLock);
-    while ((res = ccn_fetch_read(ccnfs, buf, count)) != 0) {
-      if (res > 0) {
-        *countRead += res;
-      } else if (res == CCN_FETCH_READ_NONE) {
-        if (ccn_run(mTransport->mCCNx, 1000) < 0) {
-          res = CCN_FETCH_READ_NONE;
+    MutexAutoLock connLock(conn->mLock);
+    for (;;) {
+      status = stream->mStatus;
+      if (NS_FAILED(status))
+        break;
+      // null while the driver looks up the version
+      if (stream->mFetch) {
+        opened = stream->mOpened;
+        res = ccn_fetch_read(stream->mFetch, buf, count);
+        if (res == CCN_FETCH_READ_TIMEOUT) {
+          // re-expresses the Interests that timed out
+          ccn_reset_timeout(stream->mFetch);
+          ++timeouts;
+          continue;
         }
-      } else if (res == CCN_FETCH_READ_TIMEOUT) {
-        ccn_reset_timeout(ccnfs);
-        if (ccn_run(mTransport->mCCNx, 1000) < 0) {
-          res = CCN_FETCH_READ_NONE;
+        if (res != CCN_FETCH_READ_NONE)
           break;
-        }
-      } else {
-        // CCN_FETCH_READ_NONE
-        // CCN_FETCH_READ_END
-        // and other errors
+      }
+      PRIntervalTime elapsed = PR_IntervalNow() - start;
+      if (elapsed >= timeout) {
+        // the reader is about to wait, see AsyncWait
+        stream->mWaiter = mTransport;
+        stream->mWaitStart = PR_IntervalNow();
         break;
       }
+      // a reader gathering ContentObjects into a pipe segment waits for
+      // the next run of the driver instead
+      conn->mProgress.Wait(timeout - elapsed);
+    }
+  }
+
+  for (PRUint32 i = 0; i < timeouts; ++i) {
+    ++mTimeoutCount;
+    nsCCNxTrace::Record(nsCCNxTrace::TIMEOUT, mTransport);
+    if (mTransport->mRecorder)
+      mTransport->mRecorder->Timeout(mTransport);
+    if (mTransport->mStats) {
+      mTransport->mStats->Add(nsCCNxStats::TIMEOUTS);
+      mTransport->mStats->Add(nsCCNxStats::RETRANSMITS);
+      mTransport->mStats->Add(nsCCNxStats::ESTIMATED_INTERESTS);
+    }
+  }
+
+  // ccn_fetch hands out the bytes of the stream, not its ContentObjects.
+  // Their number is estimated as if all but the last carried
+  // CCNX_SEGMENT_SIZE bytes: one counts once its last byte would be read,
+  // and the last one, short or empty, at the end of the content.
+  PRUint32 segments = 0;
+  nsresult rv;
+  {
+    MutexAutoLock lock(mTransport->mLock);
+
+    mTransport->CCNX_ReleaseLocked(stream);
+    if (!opened.IsNull() && mTransport->mTimings.mRequestStart.IsNull())
+      mTransport->mTimings.mRequestStart = opened;
+
+    if (res > 0) {
+      *countRead = res;
+      segments = PRUint32((mByteCount + res) / CCNX_SEGMENT_SIZE -
+                          mByteCount / CCNX_SEGMENT_SIZE);
+      mByteCount += res;
+      TimeStamp now = TimeStamp::Now();
+      if (mTransport->mTimings.mResponseStart.IsNull())
+        mTransport->mTimings.mResponseStart = now;
+      mTransport->mTimings.mResponseEnd = now;
+      if (mTransport->mStats)
+        mTransport->mStats->Add(nsCCNxStats::BYTES_RECEIVED, res);
+      rv = NS_OK;
+    } else if (NS_FAILED(status)) {
+      // the stream couldn't be opened, or ccnd is gone for good
+      if (NS_SUCCEEDED(mCondition))
+        mCondition = status;
+      rv = mCondition;
+    } else if (res == CCN_FETCH_READ_NONE) {
+      rv = NS_BASE_STREAM_WOULD_BLOCK;
+    } else if (res == CCN_FETCH_READ_END) {
+      // end of content, report EOF from now on
+      if (NS_SUCCEEDED(mCondition))
+        mCondition = NS_BASE_STREAM_CLOSED;
+      if (!mTransport->mCCNxComplete &&
+          (mByteCount == 0 || mByteCount % CCNX_SEGMENT_SIZE))
+        segments = 1;
+      mTransport->mCCNxComplete = true;
+      rv = NS_OK;
+    } else {
+      if (NS_SUCCEEDED(mCondition))
+        mCondition = ErrorAccordingToCCNX(res);
+      rv = mCondition;
+    }
+  }
+  if (*countRead && mTransport->mRecorder)
+    mTransport->mRecorder->Data(mTransport, *countRead);
+  if (segments) {
+    mObjectCount += segments;
+    if (mTransport->mStats) {
+      mTransport->mStats->Add(nsCCNxStats::ESTIMATED_OBJECTS, segments);
+      mTransport->mStats->Add(nsCCNxStats::ESTIMATED_INTERESTS, segments);
     }
-    mTransport->CCNX_ReleaseLocked(ccnfs);
   }
 
-  mCondition = ErrorAccordingToCCNX(res);
-  mByteCount = *countRead;
-  rv = mCondition;
-  LOG(("nsCCNxInputStream::Read %d", mByteCount));
+  nsCCNxTrace::Record(nsCCNxTrace::READ, this, *countRead);
+  LOG5(("nsCCNxInputStream::Read %d [total=%llu]", *countRead, mByteCount));
   return rv;
 }
 
@@ -198,8 +321,9 @@ nsCCNxInputStream::CloseWithStatus(nsresult reason) {
     else
       rv = NS_OK;
   }
-  //  if (NS_FAILED(rv))
-  //    mTransport->OnInputClosed(rv);
+  // let a copier waiting on a closed window find out about the closure
+  if (NS_FAILED(rv))
+    OnCCNxReady(rv);
   return NS_OK;
 }
 
@@ -224,15 +348,16 @@ nsCCNxInputStream::AsyncWait(nsIInputStreamCallback *callback,
       mCallback = callback;
     }
     
-    if (NS_FAILED(mCondition))
+    // with the window open, the driver sets mReadable once there is
+    // something to read
+    if (NS_FAILED(mCondition) ||
+        (mTransport->WindowLocked() > 0 && mTransport->mReadable))
       directCallback.swap(mCallback);
     else
       mCallbackFlags = flags;
   }
   if (directCallback)
     directCallback->OnInputStreamReady(this);
-  else
-    return NS_ERROR_NOT_IMPLEMENTED;
 
   LOG(("nsCCNxInputStream::AsyncWait"));
   return NS_OK;
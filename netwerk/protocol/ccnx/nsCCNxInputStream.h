@@ -59,12 +59,24 @@ public:
 
   bool IsReferenced()     { return mReaderRefCnt > 0; }
   nsresult Condition()    { return mCondition; }
-  //  PRUint64 ByteCount()    { return mByteCount; }
+  PRUint64 ByteCount()    { return mByteCount; }
+  // from the bytes read, see nsCCNxStats::ESTIMATED_OBJECTS
+  PRUint32 EstimatedObjects() { return mObjectCount; }
+  PRUint32 TimeoutCount() { return mTimeoutCount; }
+
+  // Read, but wait up to |timeout| for the driver to bring in a segment
+  // before giving up with NS_BASE_STREAM_WOULD_BLOCK. Read doesn't wait;
+  // after NS_BASE_STREAM_WOULD_BLOCK, AsyncWait calls back once the driver
+  // has something.
+  nsresult ReadWithin(char *buf, PRUint32 count, PRUint32 *countRead,
+                      PRIntervalTime timeout);
 
 private:
   nsCCNxTransport                    *mTransport;
   nsrefcnt                            mReaderRefCnt;
   PRUint64                            mByteCount;
+  PRUint32                            mObjectCount;
+  PRUint32                            mTimeoutCount;
 
   // access to these is protected by mTransport->mLock
   nsresult                            mCondition;
@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxInterestTemplate.h"
+
+#include "nsThreadUtils.h"
+
+extern "C" {
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+}
+
+// the images for the selectors of the prefs, stale and fresh. written on
+// the main thread before any transport exists, read-only afterwards.
+static PRInt32 gScope = CCNX_SCOPE_ANY;
+static PRUint32 gLifetime = CCNX_LIFETIME_ANY;
+static struct ccn_charbuf *gStaleImage = nsnull;
+static struct ccn_charbuf *gFreshImage = nsnull;
+
+void
+nsCCNxInterestTemplate::Init(PRInt32 scope, PRUint32 lifetime) {
+  NS_ASSERTION(NS_IsMainThread(), "wrong thread");
+  NS_ASSERTION(!gStaleImage && !gFreshImage, "Init called twice");
+
+  gScope = scope;
+  gLifetime = lifetime;
+  gStaleImage = ccn_charbuf_create();
+  Encode(gStaleImage, true, scope, lifetime);
+  gFreshImage = ccn_charbuf_create();
+  Encode(gFreshImage, false, scope, lifetime);
+}
+
+void
+nsCCNxInterestTemplate::Append(struct ccn_charbuf *out, bool allowStale,
+                               PRInt32 scope, PRUint32 lifetime) {
+  struct ccn_charbuf *image = allowStale ? gStaleImage : gFreshImage;
+  if (image && scope == gScope && lifetime == gLifetime)
+    ccn_charbuf_append_charbuf(out, image);
+  else
+    Encode(out, allowStale, scope, lifetime);
+}
+
+void
+nsCCNxInterestTemplate::Shutdown() {
+  ccn_charbuf_destroy(&gStaleImage);
+  ccn_charbuf_destroy(&gFreshImage);
+}
+
+void
+nsCCNxInterestTemplate::Encode(struct ccn_charbuf *c, bool allowStale,
+                               PRInt32 scope, PRUint32 lifetime) {
+  ccn_charbuf_append_tt(c, CCN_DTAG_Interest, CCN_DTAG);
+  ccn_charbuf_append_tt(c, CCN_DTAG_Name, CCN_DTAG);
+  ccn_charbuf_append_closer(c); /* </Name> */
+  // XXX - use pubid if possible
+  ccn_charbuf_append_tt(c, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
+  ccnb_append_number(c, 1);
+  ccn_charbuf_append_closer(c); /* </MaxSuffixComponents> */
+  if (allowStale) {
+    ccn_charbuf_append_tt(c, CCN_DTAG_AnswerOriginKind, CCN_DTAG);
+    ccnb_append_number(c, CCN_AOK_DEFAULT | CCN_AOK_STALE);
+    ccn_charbuf_append_closer(c); /* </AnswerOriginKind> */
+  }
+  AppendSelectors(c, scope, lifetime);
+  ccn_charbuf_append_closer(c); /* </Interest> */
+}
+
+void
+nsCCNxInterestTemplate::AppendResolve(struct ccn_charbuf *out,
+                                      const unsigned char *after,
+                                      size_t size, PRInt32 scope,
+                                      PRUint32 lifetime) {
+  // the version, the segment and the implicit digest
+  ccn_charbuf_append_tt(out, CCN_DTAG_Interest, CCN_DTAG);
+  ccn_charbuf_append_tt(out, CCN_DTAG_Name, CCN_DTAG);
+  ccn_charbuf_append_closer(out); /* </Name> */
+  ccn_charbuf_append_tt(out, CCN_DTAG_MinSuffixComponents, CCN_DTAG);
+  ccnb_append_number(out, 3);
+  ccn_charbuf_append_closer(out); /* </MinSuffixComponents> */
+  ccn_charbuf_append_tt(out, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
+  ccnb_append_number(out, 3);
+  ccn_charbuf_append_closer(out); /* </MaxSuffixComponents> */
+  // anything up to |after|, and from the first component past the versions
+  static const unsigned char past[] = { CCN_MARKER_VERSION + 1, 0, 0, 0,
+                                        0, 0, 0 };
+  ccn_charbuf_append_tt(out, CCN_DTAG_Exclude, CCN_DTAG);
+  ccn_charbuf_append_tt(out, CCN_DTAG_Any, CCN_DTAG);
+  ccn_charbuf_append_closer(out); /* </Any> */
+  ccnb_append_tagged_blob(out, CCN_DTAG_Component, after, size);
+  ccnb_append_tagged_blob(out, CCN_DTAG_Component, past, sizeof(past));
+  ccn_charbuf_append_tt(out, CCN_DTAG_Any, CCN_DTAG);
+  ccn_charbuf_append_closer(out); /* </Any> */
+  ccn_charbuf_append_closer(out); /* </Exclude> */
+  ccn_charbuf_append_tt(out, CCN_DTAG_ChildSelector, CCN_DTAG);
+  ccnb_append_number(out, 1);
+  ccn_charbuf_append_closer(out); /* </ChildSelector> */
+  AppendSelectors(out, scope, lifetime);
+  ccn_charbuf_append_closer(out); /* </Interest> */
+}
+
+void
+nsCCNxInterestTemplate::AppendSelectors(struct ccn_charbuf *c, PRInt32 scope,
+                                        PRUint32 lifetime) {
+  if (scope != CCNX_SCOPE_ANY) {
+    ccn_charbuf_append_tt(c, CCN_DTAG_Scope, CCN_DTAG);
+    ccnb_append_number(c, scope);
+    ccn_charbuf_append_closer(c); /* </Scope> */
+  }
+  if (lifetime != CCNX_LIFETIME_ANY) {
+    // InterestLifetime is a binary fixed point number of seconds with 12
+    // fractional bits, big endian
+    PRUint64 units = (PRUint64(lifetime) << 12) / 1000;
+    unsigned char buf[8];
+    int len = 0;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      unsigned char byte = (units >> shift) & 0xff;
+      if (len || byte)
+        buf[len++] = byte;
+    }
+    ccnb_append_tagged_blob(c, CCN_DTAG_InterestLifetime, buf, len);
+  }
+}
@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxInterestTemplate_h__
+#define nsCCNxInterestTemplate_h__
+
+#include "prtypes.h"
+#include <stddef.h>
+
+struct ccn_charbuf;
+
+// Selector values meaning "leave it out of the template".
+#define CCNX_SCOPE_ANY      -1
+#define CCNX_LIFETIME_ANY   0
+
+/**
+ * Prebuilt ccnb-encoded Interest templates. The stale and fresh variants
+ * for the scope and lifetime of the prefs are encoded once by the protocol
+ * handler, and requests copy those bytes instead of going through
+ * ccn_charbuf_append_tt for each element.
+ *
+ * The images don't change between Init and Shutdown, so Append may be
+ * called from any thread, e.g. by a blocking Open on a worker.
+ */
+class nsCCNxInterestTemplate {
+public:
+  // Encodes the images, main thread only.
+  static void Init(PRInt32 scope, PRUint32 lifetime);
+
+  // Appends the template to |out|. |lifetime| is in milliseconds. Other
+  // selectors than those given to Init are encoded on the spot.
+  static void Append(struct ccn_charbuf *out, bool allowStale,
+                     PRInt32 scope, PRUint32 lifetime);
+
+  // Frees the images, called when the protocol handler goes away.
+  static void Shutdown();
+
+  // Appends the template of an Interest for the rightmost version after
+  // the version component |after| of a name, like ccn_resolve_version
+  // asks for. Encoded every time, from any thread.
+  static void AppendResolve(struct ccn_charbuf *out,
+                            const unsigned char *after, size_t size,
+                            PRInt32 scope, PRUint32 lifetime);
+
+private:
+  static void Encode(struct ccn_charbuf *c, bool allowStale,
+                     PRInt32 scope, PRUint32 lifetime);
+  static void AppendSelectors(struct ccn_charbuf *c, PRInt32 scope,
+                              PRUint32 lifetime);
+};
+
+#endif // nsCCNxInterestTemplate_h__
@@ -39,15 +39,30 @@
 
 #include "nsCCNxProtocolHandler.h"
 #include "nsCCNxChannel.h"
+#include "nsCCNxBufferBudget.h"
+#include "nsCCNxFetchState.h"
+#include "nsCCNxContentType.h"
+#include "nsCCNxStats.h"
+#include "nsCCNxInterestTemplate.h"
+#include "nsCCNxTrace.h"
+#include "nsCCNxRecorder.h"
+#include "nsCCNxURL.h"
+#include "nsCCNxTransport.h"
+#include "nsCCNxTransportService.h"
 
 #include "nsNetUtil.h"
 #include "nsIURL.h"
 #include "nsNetCID.h"
 #include "nsIClassInfoImpl.h"
+#include "nsIRecyclingAllocator.h"
+#include "nsIObserverService.h"
+#include "nsXPCOM.h"
+#include "mozilla/Services.h"
 #include "nsStandardURL.h"
 #include "prlog.h"
 
 #include "mozilla/ModuleUtils.h"
+#include "mozilla/Preferences.h"
 #include "nsAutoPtr.h"
 
 #if defined(PR_LOGGING)
@@ -67,16 +82,28 @@ PRLogModuleInfo* gCCNxLog = nsnull;
 #undef LOG
 #define LOG(args) PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
 
+using namespace mozilla;
+
+#define BUFFER_BUDGET_PREF "network.ccnx.buffer_budget"
+#define TRACE_EVENTS_PREF  "network.ccnx.trace.events"
+#define CCND_SOCKET_PREF   "network.ccnx.ccnd_socket"
+#define RECORD_FILE_PREF   "network.ccnx.record_file"
+#define SCOPE_PREF         "network.ccnx.interest.scope"
+#define LIFETIME_PREF      "network.ccnx.interest.lifetime"
+
 //-----------------------------------------------------------------------------
 
 nsCCNxProtocolHandler* gCCNxHandler = nsnull;
 
 NS_IMPL_CLASSINFO(nsCCNxProtocolHandler, NULL, 0, NS_CCNX_HANDLER_CID)
-NS_IMPL_ISUPPORTS2_CI(nsCCNxProtocolHandler,
+NS_IMPL_ISUPPORTS3_CI(nsCCNxProtocolHandler,
                       nsIProtocolHandler,
-                      nsICCNxProtocolHandler);
+                      nsICCNxProtocolHandler,
+                      nsIObserver);
 
-nsCCNxProtocolHandler::nsCCNxProtocolHandler() {
+nsCCNxProtocolHandler::nsCCNxProtocolHandler()
+    : mInterestScope(CCNX_SCOPE_ANY)
+    , mInterestLifetime(CCNX_LIFETIME_ANY) {
 #if defined(PR_LOGGING)
     if (!gCCNxLog)
         gCCNxLog = PR_NewLogModule("nsCCNx");
@@ -87,6 +114,12 @@ nsCCNxProtocolHandler::nsCCNxProtocolHandler() {
 }
 
 nsCCNxProtocolHandler::~nsCCNxProtocolHandler() {
+  if (mTransportService)
+    mTransportService->Shutdown();
+  if (mFetchStatePool)
+    mFetchStatePool->Shutdown();
+  nsCCNxInterestTemplate::Shutdown();
+  nsCCNxTrace::Shutdown();
   gCCNxHandler = nsnull;
 }
 
@@ -95,9 +128,158 @@ nsresult nsCCNxProtocolHandler::Init() {
   mIOService = do_GetIOService(&rv);
   if (NS_FAILED(rv))
     return rv;
+
+  // the pref is in KB
+  PRUint32 budget = CCNX_DEFAULT_BUFFER_BUDGET;
+  PRInt32 val;
+  if (NS_SUCCEEDED(Preferences::GetInt(BUFFER_BUDGET_PREF, &val)) &&
+      val > 0 && val < PR_INT32_MAX / 1024)
+    budget = PRUint32(val) * 1024;
+  mBufferBudget = new nsCCNxBufferBudget(budget);
+  // unix socket of the ccnd to use instead of the default one
+  nsAdoptingCString ccndSocket = Preferences::GetCString(CCND_SOCKET_PREF);
+  mFetchStatePool = new nsCCNxFetchStatePool(CCNX_FETCH_POOL_MAX,
+                                             CCNX_MAX_CONNECTIONS, ccndSocket);
+  rv = mFetchStatePool->Init();
+  if (NS_FAILED(rv)) {
+    mFetchStatePool = nsnull;
+    return rv;
+  }
+  mContentTypes = new nsCCNxContentTypeCache();
+  mStats = new nsCCNxStats();
+
+  // selectors of the Interests: how far they may travel (0 the local
+  // applications only, 1 this host, 2 the next hop) and how long in ms they
+  // stay pending; by default ccnd decides
+  if (NS_SUCCEEDED(Preferences::GetInt(SCOPE_PREF, &val)) &&
+      val >= 0 && val <= 2)
+    mInterestScope = val;
+  if (NS_SUCCEEDED(Preferences::GetInt(LIFETIME_PREF, &val)) && val > 0)
+    mInterestLifetime = PRUint32(val);
+  // before any transport, which may be set up on any thread
+  nsCCNxInterestTemplate::Init(mInterestScope, mInterestLifetime);
+
+  mTransportService = new nsCCNxTransportService();
+  rv = mTransportService->Init();
+  if (NS_FAILED(rv)) {
+    mTransportService = nsnull;
+    return rv;
+  }
+  // the transport threads and the driver thread of the pool must be joined
+  // before XPCOM tears down threading
+  nsCOMPtr<nsIObserverService> obs = services::GetObserverService();
+  if (obs)
+    obs->AddObserver(this, NS_XPCOM_SHUTDOWN_THREADS_OBSERVER_ID, false);
+
+  // size of the event trace ring, no tracing unless set
+  if (NS_SUCCEEDED(Preferences::GetInt(TRACE_EVENTS_PREF, &val)) && val > 0)
+    nsCCNxTrace::Init(PRUint32(val));
+
+  // file to record the loads to, for tools/ccnx-replay.js
+  nsAdoptingCString recordFile = Preferences::GetCString(RECORD_FILE_PREF);
+  if (!recordFile.IsEmpty())
+    mRecorder = nsCCNxRecorder::Create(recordFile, mTransportService);
+
+  // like nsIOService's buffer cache, but sized for CCNx segments. Pipes fall
+  // back to the system allocator if it can't be created.
+  nsCOMPtr<nsIRecyclingAllocator> recyclingAllocator =
+    do_CreateInstance(NS_RECYCLINGALLOCATOR_CONTRACTID);
+  if (recyclingAllocator) {
+    rv = recyclingAllocator->Init(CCNX_SEGMENT_POOL_COUNT, (15 * 60), "ccnx");
+    if (NS_SUCCEEDED(rv))
+      mSegmentAlloc = do_QueryInterface(recyclingAllocator);
+  }
+
+  return NS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// nsIObserver
+
+NS_IMETHODIMP
+nsCCNxProtocolHandler::Observe(nsISupports *subject, const char *topic,
+                               const PRUnichar *data) {
+  if (!strcmp(topic, NS_XPCOM_SHUTDOWN_THREADS_OBSERVER_ID)) {
+    LOG(("nsCCNxProtocolHandler shutting down transport threads\n"));
+    if (mTransportService) {
+      mTransportService->Shutdown();
+      mTransportService = nsnull;
+    }
+    // after the readers, which it wakes up. transports made later fail to
+    // open their stream.
+    if (mFetchStatePool)
+      mFetchStatePool->Shutdown();
+  }
   return NS_OK;
 }
 
+//-----------------------------------------------------------------------------
+// nsICCNxProtocolHandler
+
+#define IMPL_STATS_ATTR(name, counter)                              \
+NS_IMETHODIMP                                                       \
+nsCCNxProtocolHandler::Get##name(PRUint64 *result) {                \
+  NS_ENSURE_TRUE(mStats, NS_ERROR_NOT_INITIALIZED);                 \
+  *result = mStats->Get(nsCCNxStats::counter);                      \
+  return NS_OK;                                                     \
+}
+
+IMPL_STATS_ATTR(EstimatedInterests, ESTIMATED_INTERESTS)
+IMPL_STATS_ATTR(EstimatedContentObjects, ESTIMATED_OBJECTS)
+IMPL_STATS_ATTR(Timeouts, TIMEOUTS)
+IMPL_STATS_ATTR(Retransmits, RETRANSMITS)
+IMPL_STATS_ATTR(BytesReceived, BYTES_RECEIVED)
+IMPL_STATS_ATTR(DataCallbacks, DATA_CALLBACKS)
+IMPL_STATS_ATTR(StreamsOpened, STREAMS_OPENED)
+IMPL_STATS_ATTR(ConnectionCacheHits, CONNECTION_REUSES)
+IMPL_STATS_ATTR(ContentTypeCacheHits, CONTENT_TYPE_HITS)
+
+#undef IMPL_STATS_ATTR
+
+NS_IMETHODIMP
+nsCCNxProtocolHandler::GetActiveStreams(PRUint32 *result) {
+  NS_ENSURE_TRUE(mStats, NS_ERROR_NOT_INITIALIZED);
+  *result = mStats->StreamCount();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxProtocolHandler::GetBufferedBytes(PRUint32 *result) {
+  NS_ENSURE_TRUE(mBufferBudget, NS_ERROR_NOT_INITIALIZED);
+  *result = mBufferBudget->UsedBytes();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxProtocolHandler::GetStreams(PRUint32 *count,
+                                  nsICCNxStreamInfo ***streams) {
+  NS_ENSURE_TRUE(mStats, NS_ERROR_NOT_INITIALIZED);
+
+  nsTArray<nsCCNxStreamSnapshot> snapshots;
+  mStats->GetStreams(snapshots);
+
+  *count = snapshots.Length();
+  *streams = nsnull;
+  if (snapshots.IsEmpty())
+    return NS_OK;
+
+  *streams = static_cast<nsICCNxStreamInfo**>(
+      nsMemory::Alloc(snapshots.Length() * sizeof(nsICCNxStreamInfo*)));
+  NS_ENSURE_TRUE(*streams, NS_ERROR_OUT_OF_MEMORY);
+  for (PRUint32 i = 0; i < snapshots.Length(); ++i)
+    NS_ADDREF((*streams)[i] = new nsCCNxStreamInfo(snapshots[i]));
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxProtocolHandler::DumpTrace(nsIFile *file, PRUint32 *count) {
+  NS_ENSURE_ARG_POINTER(file);
+  return nsCCNxTrace::Dump(file, count);
+}
+
+//-----------------------------------------------------------------------------
+// nsIProtocolHandler
+
 NS_IMETHODIMP nsCCNxProtocolHandler::GetScheme(nsACString & result) {
   result.AssignLiteral("ccnx");
   return NS_OK;
@@ -126,7 +308,7 @@ NS_IMETHODIMP nsCCNxProtocolHandler::NewURI(const nsACString & aSpec,
                                             nsIURI * *result) {
   nsresult rv;
   NS_ASSERTION(!aBaseURI, "Base URL passed into CCNx Protocol");
-  nsStandardURL* url = new nsStandardURL();
+  nsCCNxURL* url = new nsCCNxURL();
   if (!url)
     return NS_ERROR_OUT_OF_MEMORY;
   NS_ADDREF(url);
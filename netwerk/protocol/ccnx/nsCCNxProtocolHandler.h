@@ -42,23 +42,72 @@
 
 #include "nsICCNxProtocolHandler.h"
 #include "nsIIOService.h"
+#include "nsIObserver.h"
+#include "nsIMemory.h"
 #include "nsCOMPtr.h"
+#include "nsAutoPtr.h"
 
-class nsCCNxProtocolHandler : public nsICCNxProtocolHandler {
+class nsCCNxBufferBudget;
+class nsCCNxFetchStatePool;
+class nsCCNxContentTypeCache;
+class nsCCNxStats;
+class nsCCNxRecorder;
+class nsCCNxTransportService;
+
+class nsCCNxProtocolHandler : public nsICCNxProtocolHandler
+                            , public nsIObserver {
 public:
   nsCCNxProtocolHandler();
   NS_DECL_ISUPPORTS
   NS_DECL_NSIPROTOCOLHANDLER
   NS_DECL_NSICCNXPROTOCOLHANDLER
+  NS_DECL_NSIOBSERVER
 
   nsresult Init();
   //  static NS_METHOD Create(nsISupports* aOuter, const nsIID& aIID, void* *aResult);
   virtual ~nsCCNxProtocolHandler();
 
+  // process-wide accounting of bytes buffered by the CCNx transports
+  nsCCNxBufferBudget *BufferBudget() { return mBufferBudget; }
+
+  // recycling allocator for CCNX_SEGMENT_SIZE pipe segments, may be null
+  nsIMemory *SegmentAlloc() { return mSegmentAlloc; }
+
+  // idle ccnd connections and fetch handles kept for reuse
+  nsCCNxFetchStatePool *FetchStatePool() { return mFetchStatePool; }
+
+  // content types of names loaded before, main thread only
+  nsCCNxContentTypeCache *ContentTypes() { return mContentTypes; }
+
+  // counters and open streams, see nsICCNxProtocolHandler
+  nsCCNxStats *Stats() { return mStats; }
+
+  // record of the loads for replaying them, null unless asked for
+  nsCCNxRecorder *Recorder() { return mRecorder; }
+
+  // threads the transports read on, null once shut down
+  nsCCNxTransportService *TransportService() { return mTransportService; }
+
+  // Interest selectors for nsCCNxInterestTemplate, CCNX_SCOPE_ANY and
+  // CCNX_LIFETIME_ANY unless set by pref
+  PRInt32 InterestScope() { return mInterestScope; }
+  PRUint32 InterestLifetime() { return mInterestLifetime; }
+
 private:
   nsCOMPtr<nsIIOService> mIOService;
+  nsRefPtr<nsCCNxBufferBudget> mBufferBudget;
+  nsCOMPtr<nsIMemory> mSegmentAlloc;
+  nsRefPtr<nsCCNxFetchStatePool> mFetchStatePool;
+  nsAutoPtr<nsCCNxContentTypeCache> mContentTypes;
+  nsRefPtr<nsCCNxStats> mStats;
+  nsRefPtr<nsCCNxTransportService> mTransportService;
+  nsRefPtr<nsCCNxRecorder> mRecorder;
+  PRInt32 mInterestScope;
+  PRUint32 mInterestLifetime;
 };
 
+extern nsCCNxProtocolHandler *gCCNxHandler;
+
 #ifdef PR_LOGGING
 extern PRLogModuleInfo* gNDNLog;
 #endif
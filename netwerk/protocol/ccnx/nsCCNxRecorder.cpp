@@ -0,0 +1,163 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxRecorder.h"
+
+#include "nsThreadUtils.h"
+#include "prprf.h"
+#include "prtime.h"
+
+using namespace mozilla;
+
+#if defined(PR_LOGGING)
+extern PRLogModuleInfo* gCCNxLog;
+#endif
+#define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
+
+// longest line without the name
+#define CCNX_RECORD_LINE_MAX 96
+
+nsCCNxRecorder *
+nsCCNxRecorder::Create(const nsACString &path, nsIEventTarget *target) {
+  PRFileDesc *fd = PR_Open(PromiseFlatCString(path).get(),
+                           PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE, 0644);
+  if (!fd) {
+    LOG(("nsCCNxRecorder can't open %s", PromiseFlatCString(path).get()));
+    return nsnull;
+  }
+  LOG(("nsCCNxRecorder recording to %s", PromiseFlatCString(path).get()));
+  nsCCNxRecorder *recorder = new nsCCNxRecorder(fd, target);
+  // the times of the records are relative to this one when replayed
+  char buf[CCNX_RECORD_LINE_MAX];
+  PRUint32 n = PR_snprintf(buf, sizeof(buf), "# ccnx-record %d %lld\n",
+                           CCNX_RECORD_FORMAT, PR_Now());
+  recorder->Append(buf, n, false);
+  return recorder;
+}
+
+nsCCNxRecorder::nsCCNxRecorder(PRFileDesc *fd, nsIEventTarget *target)
+    : mLock("nsCCNxRecorder.mLock")
+    , mFD(fd)
+    , mTarget(target)
+    , mFlushPending(false) {
+  mBuffer.SetCapacity(CCNX_RECORD_BUFFER_SIZE);
+}
+
+nsCCNxRecorder::~nsCCNxRecorder() {
+  // Flush events hold a reference, so none is pending. Whatever came after
+  // the target shut down is written here.
+  if (!mBuffer.IsEmpty())
+    PR_Write(mFD, mBuffer.get(), mBuffer.Length());
+  PR_Close(mFD);
+}
+
+void
+nsCCNxRecorder::StreamOpened(const void *stream, PRUint32 window,
+                             const nsACString &name) {
+  nsCAutoString line;
+  char buf[CCNX_RECORD_LINE_MAX];
+  PRUint32 n = PR_snprintf(buf, sizeof(buf), "open %lld %p %u ",
+                           PR_Now(), stream, window);
+  line.Assign(buf, n);
+  line.Append(name);
+  line.Append('\n');
+  Append(line.get(), line.Length(), false);
+}
+
+void
+nsCCNxRecorder::Data(const void *stream, PRUint32 bytes) {
+  char buf[CCNX_RECORD_LINE_MAX];
+  PRUint32 n = PR_snprintf(buf, sizeof(buf), "data %lld %p %u\n",
+                           PR_Now(), stream, bytes);
+  Append(buf, n, false);
+}
+
+void
+nsCCNxRecorder::Timeout(const void *stream) {
+  char buf[CCNX_RECORD_LINE_MAX];
+  PRUint32 n = PR_snprintf(buf, sizeof(buf), "timeout %lld %p\n",
+                           PR_Now(), stream);
+  Append(buf, n, false);
+}
+
+void
+nsCCNxRecorder::StreamClosed(const void *stream, nsresult status) {
+  char buf[CCNX_RECORD_LINE_MAX];
+  PRUint32 n = PR_snprintf(buf, sizeof(buf), "close %lld %p 0x%08x\n",
+                           PR_Now(), stream, PRUint32(status));
+  // a finished load is worth having on disk right away
+  Append(buf, n, true);
+}
+
+void
+nsCCNxRecorder::Append(const char *line, PRUint32 length, bool flush) {
+  {
+    MutexAutoLock lock(mLock);
+    mBuffer.Append(line, length);
+    if (mFlushPending ||
+        (!flush && mBuffer.Length() < CCNX_RECORD_BUFFER_SIZE))
+      return;
+    mFlushPending = true;
+  }
+  // outside of the lock, which is a leaf: the target takes its own
+  nsCOMPtr<nsIRunnable> event =
+    NS_NewRunnableMethod(this, &nsCCNxRecorder::Flush);
+  if (!mTarget || NS_FAILED(mTarget->Dispatch(event, NS_DISPATCH_NORMAL))) {
+    // shutting down, the destructor writes the rest
+    MutexAutoLock lock(mLock);
+    mFlushPending = false;
+  }
+}
+
+void
+nsCCNxRecorder::Flush() {
+  while (true) {
+    nsCString records;
+    {
+      MutexAutoLock lock(mLock);
+      if (mBuffer.IsEmpty()) {
+        mFlushPending = false;
+        return;
+      }
+      records.Assign(mBuffer);
+      mBuffer.Truncate();
+    }
+    // records added meanwhile are picked up by the next round
+    PR_Write(mFD, records.get(), records.Length());
+  }
+}
@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxRecorder_h__
+#define nsCCNxRecorder_h__
+
+#include "nsISupportsImpl.h"
+#include "nsCOMPtr.h"
+#include "nsIEventTarget.h"
+#include "nsString.h"
+#include "mozilla/Mutex.h"
+#include "prio.h"
+
+// Bytes of records gathered before they are handed to the writer.
+#define CCNX_RECORD_BUFFER_SIZE 8192
+
+// Version of the record lines, in the header.
+#define CCNX_RECORD_FORMAT 2
+
+/**
+ * Records what the transports ask for and get, for replaying real loads
+ * later with tools/ccnx-replay.js and tools/fake-ccnd.py. The file starts
+ * over every session with a header line, then one line per event, oldest
+ * first:
+ *
+ *   # ccnx-record <format> <usec>
+ *   open <usec> <stream> <window> <ccnx name>
+ *   data <usec> <stream> <bytes>
+ *   timeout <usec> <stream>
+ *   close <usec> <stream> <nsresult>
+ *
+ * where <usec> is PR_Now() and <stream> identifies the transport from its
+ * open to its close. ccn_fetch hands out bytes and expresses the Interests
+ * itself, so a data line is one read of the transport, whatever the
+ * ContentObjects it came in (format 1 had a line per 4096 bytes instead),
+ * and only the timeouts of the Interests are seen. Owned by the
+ * protocol handler and created only when network.ccnx.record_file names a
+ * file. Used from any thread; the lock is taken last, so records may be
+ * added with a transport lock held. The file is only written by Flush
+ * events dispatched to |target| (the transport service), one at a time so
+ * that the lines stay in order, and by the destructor for what is left at
+ * shutdown.
+ */
+class nsCCNxRecorder {
+  typedef mozilla::Mutex Mutex;
+
+public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxRecorder)
+
+  // Truncates the file at |path| and writes the header. Returns null if it
+  // can't be opened.
+  static nsCCNxRecorder *Create(const nsACString &path,
+                                nsIEventTarget *target);
+
+  void StreamOpened(const void *stream, PRUint32 window,
+                    const nsACString &name);
+  void Data(const void *stream, PRUint32 bytes);
+  void Timeout(const void *stream);
+  void StreamClosed(const void *stream, nsresult status);
+
+private:
+  nsCCNxRecorder(PRFileDesc *fd, nsIEventTarget *target);
+  ~nsCCNxRecorder();
+
+  void Append(const char *line, PRUint32 length, bool flush);
+  // writes out the records on the target
+  void Flush();
+
+  Mutex                             mLock;
+  PRFileDesc                       *mFD;
+  nsCOMPtr<nsIEventTarget>          mTarget;
+  // records not handed to Flush yet
+  nsCString                         mBuffer;
+  // a Flush event is on its way or running
+  bool                              mFlushPending;
+};
+
+#endif // nsCCNxRecorder_h__
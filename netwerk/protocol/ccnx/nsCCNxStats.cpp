@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxStats.h"
+#include "nsCCNxTransport.h"
+
+using namespace mozilla;
+
+nsCCNxStats::nsCCNxStats()
+    : mCounterLock("nsCCNxStats.mCounterLock")
+    , mStreamLock("nsCCNxStats.mStreamLock") {
+  for (PRUint32 i = 0; i < COUNTER_COUNT; ++i)
+    mCounters[i] = 0;
+}
+
+void
+nsCCNxStats::Add(Counter counter, PRUint64 n) {
+  MutexAutoLock lock(mCounterLock);
+  mCounters[counter] += n;
+}
+
+PRUint64
+nsCCNxStats::Get(Counter counter) {
+  MutexAutoLock lock(mCounterLock);
+  return mCounters[counter];
+}
+
+void
+nsCCNxStats::AddStream(nsCCNxTransport *trans) {
+  {
+    MutexAutoLock lock(mStreamLock);
+    mStreams.AppendElement(trans);
+  }
+  Add(STREAMS_OPENED);
+}
+
+void
+nsCCNxStats::RemoveStream(nsCCNxTransport *trans) {
+  MutexAutoLock lock(mStreamLock);
+  mStreams.RemoveElement(trans);
+}
+
+PRUint32
+nsCCNxStats::StreamCount() {
+  MutexAutoLock lock(mStreamLock);
+  return mStreams.Length();
+}
+
+void
+nsCCNxStats::GetStreams(nsTArray<nsCCNxStreamSnapshot> &result) {
+  // a transport leaves the table before it goes away, so the ones in it
+  // can be looked at while we hold the lock
+  MutexAutoLock lock(mStreamLock);
+  result.SetLength(mStreams.Length());
+  for (PRUint32 i = 0; i < mStreams.Length(); ++i)
+    mStreams[i]->GetSnapshot(&result[i]);
+}
+
+//-----------------------------------------------------------------------------
+// nsCCNxStreamInfo
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(nsCCNxStreamInfo, nsICCNxStreamInfo)
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetName(nsACString &aName) {
+  aName = mSnapshot.mName;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetBytesRead(PRUint64 *aBytesRead) {
+  *aBytesRead = mSnapshot.mBytesRead;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetWindow(PRUint32 *aWindow) {
+  *aWindow = mSnapshot.mWindow;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetBufferedBytes(PRUint32 *aBufferedBytes) {
+  *aBufferedBytes = mSnapshot.mBuffered;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetPriority(PRInt32 *aPriority) {
+  *aPriority = mSnapshot.mPriority;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetSuspended(bool *aSuspended) {
+  *aSuspended = mSnapshot.mSuspended;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+nsCCNxStreamInfo::GetThrottled(bool *aThrottled) {
+  *aThrottled = mSnapshot.mThrottled;
+  return NS_OK;
+}
@@ -0,0 +1,134 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxStats_h__
+#define nsCCNxStats_h__
+
+#include "nsICCNxProtocolHandler.h"
+#include "nsISupportsImpl.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "mozilla/Mutex.h"
+
+class nsCCNxTransport;
+
+// State of one open CCNx stream at the time it was looked at.
+struct nsCCNxStreamSnapshot {
+  nsCString                         mName;
+  PRUint64                          mBytesRead;
+  PRUint32                          mWindow;
+  PRUint32                          mBuffered;
+  PRInt32                           mPriority;
+  bool                              mSuspended;
+  bool                              mThrottled;
+};
+
+/**
+ * Process-wide counters of the CCNx transports and the table of the open
+ * ones, exposed through nsICCNxProtocolHandler and about:ccnx. Owned by the
+ * protocol handler, used from any thread.
+ *
+ * Counters are guarded by a lock of their own that is taken last, so they
+ * may be bumped with a transport's lock held. The stream table lock is
+ * taken before the transport locks while taking a snapshot.
+ */
+class nsCCNxStats {
+  typedef mozilla::Mutex Mutex;
+
+public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(nsCCNxStats)
+
+  enum Counter {
+    STREAMS_OPENED,
+    // ccn_fetch neither tells about the Interests it expresses nor about
+    // the ContentObjects it gets, only the bytes: these are estimates from
+    // the bytes read, as if every segment but the last of a stream carried
+    // CCNX_SEGMENT_SIZE bytes, and one Interest per segment and timeout
+    ESTIMATED_INTERESTS,
+    ESTIMATED_OBJECTS,
+    BYTES_RECEIVED,
+    // OnDataAvailable calls to the listeners of the channels, i.e. the
+    // readiness events the pipes caused
+    DATA_CALLBACKS,
+    TIMEOUTS,
+    RETRANSMITS,
+    // requests served with a pooled ccnd connection
+    CONNECTION_REUSES,
+    // loads whose content type was known before any data arrived
+    CONTENT_TYPE_HITS,
+    COUNTER_COUNT
+  };
+
+  nsCCNxStats();
+
+  void Add(Counter counter, PRUint64 n = 1);
+  PRUint64 Get(Counter counter);
+
+  // open transports, added once they are initialized
+  void AddStream(nsCCNxTransport *trans);
+  void RemoveStream(nsCCNxTransport *trans);
+  PRUint32 StreamCount();
+  void GetStreams(nsTArray<nsCCNxStreamSnapshot> &result);
+
+private:
+  ~nsCCNxStats() {}
+
+  Mutex                             mCounterLock;
+  PRUint64                          mCounters[COUNTER_COUNT];
+
+  Mutex                             mStreamLock;
+  nsTArray<nsCCNxTransport*>        mStreams;
+};
+
+/**
+ * nsICCNxStreamInfo over a snapshot.
+ */
+class nsCCNxStreamInfo : public nsICCNxStreamInfo {
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSICCNXSTREAMINFO
+
+  nsCCNxStreamInfo(const nsCCNxStreamSnapshot &snapshot)
+      : mSnapshot(snapshot) {
+  }
+
+private:
+  nsCCNxStreamSnapshot              mSnapshot;
+};
+
+#endif // nsCCNxStats_h__
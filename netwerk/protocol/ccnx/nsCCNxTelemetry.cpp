@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxTelemetry.h"
+#include "nsAlgorithm.h"
+#include "nsMemory.h"
+#include "prlog.h"
+
+#include "mozilla/Telemetry.h"
+
+using namespace mozilla;
+
+namespace {
+
+// declared in TelemetryHistograms.h, see TelemetryHistograms.h.ccnx.patch
+const Telemetry::ID gHistogramIDs[] = {
+  Telemetry::CCNX_TIME_TO_FIRST_BYTE_MS,
+  Telemetry::CCNX_LOAD_TIME_MS,
+  Telemetry::CCNX_CONNECT_MS,
+  Telemetry::CCNX_THROUGHPUT_SMALL_KBPS,
+  Telemetry::CCNX_THROUGHPUT_MEDIUM_KBPS,
+  Telemetry::CCNX_THROUGHPUT_LARGE_KBPS,
+  Telemetry::CCNX_TIMEOUT_RATE,
+};
+
+PR_STATIC_ASSERT(NS_ARRAY_LENGTH(gHistogramIDs) ==
+                 nsCCNxTelemetry::HISTOGRAM_COUNT);
+
+} // anonymous namespace
+
+void
+nsCCNxTelemetry::Accumulate(ID id, PRUint32 sample) {
+  Telemetry::Accumulate(gHistogramIDs[id], sample);
+}
+
+void
+nsCCNxTelemetry::AccumulateTimeDelta(ID id, TimeStamp start, TimeStamp end) {
+  if (start.IsNull() || end.IsNull() || end < start)
+    return;
+  Accumulate(id, static_cast<PRUint32>((end - start).ToMilliseconds()));
+}
+
+void
+nsCCNxTelemetry::AccumulateThroughput(PRUint64 bytes, TimeDuration time) {
+  double ms = time.ToMilliseconds();
+  if (!bytes || ms <= 0)
+    return;
+
+  ID id;
+  if (bytes < 64 * 1024)
+    id = THROUGHPUT_SMALL;
+  else if (bytes < 1024 * 1024)
+    id = THROUGHPUT_MEDIUM;
+  else
+    id = THROUGHPUT_LARGE;
+  // bytes per ms is about KB per s
+  Accumulate(id, static_cast<PRUint32>(NS_MIN<double>(bytes / ms,
+                                                      PR_UINT32_MAX)));
+}
@@ -0,0 +1,81 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxTelemetry_h__
+#define nsCCNxTelemetry_h__
+
+#include "prtypes.h"
+#include "mozilla/TimeStamp.h"
+
+/**
+ * Telemetry histograms of CCNx loads, the CCNX_* entries that
+ * toolkit/components/telemetry/TelemetryHistograms.h.ccnx.patch adds to
+ * TelemetryHistograms.h. Any thread.
+ */
+class nsCCNxTelemetry {
+public:
+  enum ID {
+    // AsyncOpen to OnStartRequest (ms)
+    TIME_TO_FIRST_BYTE,
+    // AsyncOpen to OnStopRequest of a successful load (ms)
+    LOAD_TIME,
+    // getting a new ccnd connection, reused ones aren't counted (ms)
+    CONNECT_TIME,
+    // request start to last ContentObject of a complete stream (KB/s),
+    // by object size
+    THROUGHPUT_SMALL,   // < 64 KB
+    THROUGHPUT_MEDIUM,  // < 1 MB
+    THROUGHPUT_LARGE,
+    // Interest timeouts (each one retransmitted) per 100 ContentObjects,
+    // estimated from the bytes read like nsCCNxStats::ESTIMATED_OBJECTS
+    TIMEOUT_RATE,
+    HISTOGRAM_COUNT
+  };
+
+  static void Accumulate(ID id, PRUint32 sample);
+
+  // adds end - start in ms, nothing if either of them is null
+  static void AccumulateTimeDelta(ID id, mozilla::TimeStamp start,
+                                  mozilla::TimeStamp end =
+                                    mozilla::TimeStamp::Now());
+
+  // sorts a throughput sample into the histogram for |bytes|
+  static void AccumulateThroughput(PRUint64 bytes, mozilla::TimeDuration time);
+};
+
+#endif // nsCCNxTelemetry_h__
@@ -0,0 +1,218 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxTrace.h"
+
+#include "nsCOMPtr.h"
+#include "nsTArray.h"
+#include "nsNetUtil.h"
+#include "nsIFile.h"
+#include "nsIOutputStream.h"
+#include "pratom.h"
+#include "prmem.h"
+#include "prthread.h"
+
+#ifdef XP_WIN
+#include <windows.h>
+#endif
+
+#define CCNX_TRACE_VERSION 1
+
+namespace {
+
+// full memory barrier, for the seqlock of the ring. NSPR's atomics are
+// barriers on every platform, the compiler builtins are cheaper.
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+PRInt32 gBarrier;
+#endif
+
+inline void
+Barrier() {
+#if defined(__GNUC__)
+  __sync_synchronize();
+#elif defined(_MSC_VER)
+  MemoryBarrier();
+#else
+  PR_ATOMIC_ADD(&gBarrier, 0);
+#endif
+}
+
+inline PRUint32
+ReadSeq(const nsCCNxTraceEvent *e) {
+  return *static_cast<const volatile PRUint32*>(&e->mSeq);
+}
+
+inline void
+WriteSeq(nsCCNxTraceEvent *e, PRUint32 seq) {
+  *static_cast<volatile PRUint32*>(&e->mSeq) = seq;
+}
+
+} // anonymous namespace
+
+nsCCNxTraceEvent *nsCCNxTrace::sRing = nsnull;
+PRUint32 nsCCNxTrace::sMask = 0;
+PRInt32 nsCCNxTrace::sNext = 0;
+
+void
+nsCCNxTrace::Init(PRUint32 events) {
+  if (sRing || !events)
+    return;
+
+  PRUint32 size = 1;
+  while (size < events && size < (1U << 24))
+    size <<= 1;
+  sRing = static_cast<nsCCNxTraceEvent*>(
+    PR_Calloc(size, sizeof(nsCCNxTraceEvent)));
+  if (sRing)
+    sMask = size - 1;
+}
+
+void
+nsCCNxTrace::Shutdown() {
+  nsCCNxTraceEvent *ring = sRing;
+  sRing = nsnull;
+  PR_Free(ring);
+}
+
+void
+nsCCNxTrace::Append(Type type, const void *object, PRUint64 arg) {
+  PRUint32 seq = PRUint32(PR_ATOMIC_INCREMENT(&sNext));
+  // 0 marks a record being written
+  if (!seq)
+    seq = PRUint32(PR_ATOMIC_INCREMENT(&sNext));
+
+  nsCCNxTraceEvent *e = &sRing[seq & sMask];
+  // readers see either a zero mSeq or all the fields that go with the
+  // number, see Dump
+  WriteSeq(e, 0);
+  Barrier();
+  e->mTime = PR_Now();
+  e->mObject = PRUint64(PRUptrdiff(object));
+  e->mArg = arg;
+  e->mType = PRUint16(type);
+  PRUptrdiff thread = PRUptrdiff(PR_GetCurrentThread());
+  e->mThread = PRUint16((thread >> 4) ^ (thread >> 20));
+  // release: the fields are visible before the number is
+  Barrier();
+  WriteSeq(e, seq);
+}
+
+namespace {
+
+// oldest first, relative to the last sequence number handed out
+class AgeComparator {
+public:
+  AgeComparator(PRUint32 last) : mLast(last) {}
+  bool Equals(const nsCCNxTraceEvent &a, const nsCCNxTraceEvent &b) const {
+    return a.mSeq == b.mSeq;
+  }
+  bool LessThan(const nsCCNxTraceEvent &a, const nsCCNxTraceEvent &b) const {
+    return mLast - a.mSeq > mLast - b.mSeq;
+  }
+private:
+  PRUint32 mLast;
+};
+
+nsresult
+WriteAll(nsIOutputStream *out, const void *data, PRUint32 count) {
+  const char *buf = static_cast<const char*>(data);
+  while (count) {
+    PRUint32 written;
+    nsresult rv = out->Write(buf, count, &written);
+    if (NS_FAILED(rv))
+      return rv;
+    if (!written)
+      return NS_ERROR_FAILURE;
+    buf += written;
+    count -= written;
+  }
+  return NS_OK;
+}
+
+} // anonymous namespace
+
+nsresult
+nsCCNxTrace::Dump(nsIFile *file, PRUint32 *count) {
+  if (!sRing)
+    return NS_ERROR_NOT_AVAILABLE;
+
+  // writers keep going while we copy; records caught half written or
+  // already overwritten by a later lap are left out
+  PRUint32 last = PRUint32(sNext);
+  nsTArray<nsCCNxTraceEvent> events;
+  if (!events.SetCapacity(sMask + 1))
+    return NS_ERROR_OUT_OF_MEMORY;
+  for (PRUint32 i = 0; i <= sMask; ++i) {
+    PRUint32 seq = ReadSeq(&sRing[i]);
+    if (!seq || (seq & sMask) != i || last - seq > sMask)
+      continue;
+    Barrier();
+    nsCCNxTraceEvent e = sRing[i];
+    Barrier();
+    // a writer started on the record while we copied it
+    if (ReadSeq(&sRing[i]) != seq)
+      continue;
+    events.AppendElement(e);
+  }
+  events.Sort(AgeComparator(last));
+
+  nsCOMPtr<nsIOutputStream> out;
+  nsresult rv = NS_NewLocalFileOutputStream(getter_AddRefs(out), file);
+  if (NS_FAILED(rv))
+    return rv;
+
+  nsCCNxTraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.mMagic, "CCNXTRC", 8);
+  header.mVersion = CCNX_TRACE_VERSION;
+  header.mRecordSize = sizeof(nsCCNxTraceEvent);
+  header.mCount = events.Length();
+  header.mByteOrder = 0x01020304;
+  header.mDumpTime = PR_Now();
+
+  rv = WriteAll(out, &header, sizeof(header));
+  if (NS_SUCCEEDED(rv) && events.Length())
+    rv = WriteAll(out, events.Elements(),
+                  events.Length() * sizeof(nsCCNxTraceEvent));
+  out->Close();
+  if (NS_FAILED(rv))
+    return rv;
+
+  *count = events.Length();
+  return NS_OK;
+}
@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxTrace_h__
+#define nsCCNxTrace_h__
+
+#include "prtypes.h"
+
+class nsIFile;
+
+// One trace record, 32 bytes. This is also the record layout of the dump
+// files read by tools/decode-ccnx-trace.py, so keep the two in sync.
+struct nsCCNxTraceEvent {
+  PRInt64                           mTime;    // PR_Now(), microseconds
+  PRUint64                          mObject;  // transport, core or stream
+  PRUint64                          mArg;     // depends on mType
+  PRUint32                          mSeq;     // 0 while being written
+  PRUint16                          mType;
+  PRUint16                          mThread;  // folded PRThread pointer
+};
+
+// Header of a dump file, followed by |mCount| records in mSeq order.
+struct nsCCNxTraceHeader {
+  char                              mMagic[8];    // "CCNXTRC"
+  PRUint32                          mVersion;
+  PRUint32                          mRecordSize;
+  PRUint32                          mCount;
+  PRUint32                          mByteOrder;   // 0x01020304, native
+  PRInt64                           mDumpTime;
+};
+
+/**
+ * Binary trace of the CCNx hot path, for when NSPR logging would change
+ * the timing being looked at. Events are written to a fixed ring, lock-free,
+ * from any thread; the ring is dumped to a file on demand through
+ * nsICCNxProtocolHandler.dumpTrace. mSeq of a record works as a seqlock:
+ * the writer zeroes it before and publishes it after the other fields, and
+ * Dump keeps a copy only if mSeq read the same, non-zero, around it.
+ *
+ * Off unless network.ccnx.trace.events asks for a ring at startup, in which
+ * case recording is one atomic increment, two memory barriers and a 32 byte
+ * store per event.
+ */
+class nsCCNxTrace {
+public:
+  enum Type {
+    OPEN = 1,       // arg: initial window
+    // 2 and 3 were Interests expressed and ContentObjects read, which
+    // ccn_fetch doesn't tell about
+    TIMEOUT = 4,
+    READ,           // arg: bytes returned to the reader
+    CALLBACK,       // arg: 1 if dispatched to the callback's target
+    CLOSE           // arg: nsresult
+  };
+
+  // Sets up a ring of |events| records, rounded up to a power of two.
+  // Called by the protocol handler on the main thread.
+  static void Init(PRUint32 events);
+  static void Shutdown();
+
+  static void Record(Type type, const void *object, PRUint64 arg = 0) {
+    if (sRing)
+      Append(type, object, arg);
+  }
+
+  // Writes the current ring contents to |file|. NS_ERROR_NOT_AVAILABLE if
+  // tracing is off. Main thread.
+  static nsresult Dump(nsIFile *file, PRUint32 *count);
+
+private:
+  static void Append(Type type, const void *object, PRUint64 arg);
+
+  static nsCCNxTraceEvent          *sRing;
+  static PRUint32                   sMask;
+  static PRInt32                    sNext;
+};
+
+#endif // nsCCNxTrace_h__
@@ -38,81 +38,243 @@
 
 #include "nsCCNxError.h"
 #include "nsCCNxTransport.h"
+#include "nsCCNxProtocolHandler.h"
+#include "nsCCNxInterestTemplate.h"
+#include "nsCCNxTelemetry.h"
+#include "nsCCNxTrace.h"
 
+#include "sampler.h"
+#include "nsAlgorithm.h"
 #include "nsNetSegmentUtils.h"
 #include "nsStreamUtils.h"
+#include "nsTransportUtils.h"
+#include "nsThreadUtils.h"
 
 #include "nsIPipe.h"
+#include "nsISocketTransport.h"
+#include "nsISupportsPriority.h"
 
 #if defined(PR_LOGGING)
 extern PRLogModuleInfo* gCCNxLog;
 #endif
 #define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
 
-NS_IMPL_THREADSAFE_ISUPPORTS1(nsCCNxTransport,
-                              nsITransport)
+using namespace mozilla;
+
+// Number of segment Interests a stream keeps in flight (maxBufs of
+// ccn_fetch_open), copied from ccnwget.
+#define CCNX_DEFAULT_WINDOW 4
+
+// How long in ms a partly filled pipe segment waits for more ContentObjects
+// before it is handed to the reader anyway.
+#define CCNX_FILL_DELAY 10
+
+NS_IMPL_THREADSAFE_ISUPPORTS3(nsCCNxTransport,
+                              nsITransport,
+                              nsIInputStreamCallback,
+                              nsIOutputStreamCallback)
 
 nsCCNxTransport::nsCCNxTransport()
     : mLock("nsCCNxTransport.mLock"),
-      mCCNx(nsnull),
-      mCCNxFetch(nsnull),
-      mCCNxName(nsnull),
-      mCCNxTmpl(nsnull),
-      mCCNxStream(nsnull),
       mCCNxRef(0),
       mCCNxOnline(false),
+      mCCNxComplete(false),
       mInputClosed(true),
+      mMaxWindow(CCNX_DEFAULT_WINDOW),
+      mSuspendCount(0),
+      mThrottled(false),
+      mReadable(false),
+      mPriority(nsISupportsPriority::PRIORITY_NORMAL),
+      mLastProgress(0),
+      mProgressReported(0),
       mInput(this) {
 
   LOG(("create nsCCNxTransport @%p", this));
 }
 
 nsCCNxTransport::~nsCCNxTransport() {
-  mService->Shutdown();
+  // no reader is left, the counts of mInput are final
+  RecordTelemetry();
+  // nobody closed us, e.g. the pipe of a blocking reader was dropped before
+  // the end of the content
+  ReleaseCCNx(NS_ERROR_ABORT);
   LOG(("destroy nsCCNxTransport @%p", this));
 }
 
 nsresult
-nsCCNxTransport::Init(const char *ccnxName) {
+nsCCNxTransport::Init(nsCCNxURL *url) {
   // the current implementation only allows one ccn name
-  int res;
-  mService = new nsCCNxTransportService();
-  mService->Init();
-
-  // create ccn connection
-  mCCNx = ccn_create();
-  res = ccn_connect(mCCNx, NULL);
-  if (res < 0) {
-    ccn_destroy(&mCCNx);
+  nsresult rv;
+  if (gCCNxHandler) {
+    mService = gCCNxHandler->TransportService();
+    mBudget = gCCNxHandler->BufferBudget();
+    mStatePool = gCCNxHandler->FetchStatePool();
+    mStats = gCCNxHandler->Stats();
+    mRecorder = gCCNxHandler->Recorder();
+  }
+  // no threads to read on, e.g. during shutdown
+  if (!mService || !mStatePool)
+    return NS_ERROR_NOT_INITIALIZED;
+
+  // the URL has parsed and encoded the name already
+  const struct ccn_charbuf *name;
+  rv = url->GetCCNxName(&name);
+  if (NS_FAILED(rv))
+    return rv;
+  rv = url->GetCanonicalName(mCCNxURI);
+  if (NS_FAILED(rv))
+    return rv;
+
+  // get a ccn connection along with the fetch handle
+  SendStatus(nsISocketTransport::STATUS_CONNECTING_TO);
+  TimeStamp connectStart = TimeStamp::Now();
+  bool reused = false;
+  nsCCNxFetchState *state = mStatePool->Get(&reused);
+  if (!state)
     return NS_ERROR_CCNX_UNAVAIL;
+  TimeStamp connectEnd = TimeStamp::Now();
+
+  // the driver thread of the pool resolves the version and opens the
+  // stream, so that we don't wait for ccnd here
+  mFetchStream = new nsCCNxFetchStream(state, mCCNxURI, mMaxWindow);
+  ccn_charbuf_append_charbuf(mFetchStream->mName, name);
+  CCNX_MakeTemplate(0);
+  rv = mStatePool->Open(mFetchStream);
+  if (NS_FAILED(rv)) {
+    // shutting down, the pool takes the connection back when it goes away
+    mStatePool->Close(mFetchStream, false);
+    mFetchStream = nsnull;
+    return rv;
+  }
+  if (mStats && reused)
+    mStats->Add(nsCCNxStats::CONNECTION_REUSES);
+  if (!reused)
+    nsCCNxTelemetry::AccumulateTimeDelta(nsCCNxTelemetry::CONNECT_TIME,
+                                         connectStart, connectEnd);
+
+  // the transport holds a reference on the connection until Close
+  {
+    MutexAutoLock lock(mLock);
+    mCCNxRef = 1;
+    mCCNxOnline = true;
+    mTimings.mConnectStart = connectStart;
+    mTimings.mConnectEnd = connectEnd;
   }
+  if (mStats)
+    mStats->AddStream(this);
+  nsCCNxTrace::Record(nsCCNxTrace::OPEN, this, mMaxWindow);
+  if (mRecorder)
+    mRecorder->StreamOpened(this, mMaxWindow, mCCNxURI);
+  return NS_OK;
+}
 
-  // create name buffer
-  mCCNxName = ccn_charbuf_create();
-  mCCNxName->length = 0;
-  res = ccn_name_from_uri(mCCNxName, ccnxName);
-  if (res < 0) {
-    ccn_destroy(&mCCNx);
-    ccn_charbuf_destroy(&mCCNxName);
-    return NS_ERROR_CCNX_INVALID_NAME;
+void
+nsCCNxTransport::Suspend() {
+  MutexAutoLock lock(mLock);
+  ++mSuspendCount;
+  LOG(("nsCCNxTransport::Suspend [this=%p count=%u]\n",
+       this, mSuspendCount));
+}
+
+void
+nsCCNxTransport::Resume() {
+  {
+    MutexAutoLock lock(mLock);
+    NS_ASSERTION(mSuspendCount > 0, "unbalanced Resume");
+    if (mSuspendCount == 0 || --mSuspendCount > 0)
+      return;
   }
+  LOG(("nsCCNxTransport::Resume [this=%p]\n", this));
+  // reopen the window: wake up the copier waiting on our input stream
+  mInput.OnCCNxReady(NS_OK);
+}
 
-  // initialize ccn fetch
-  mCCNxFetch = ccn_fetch_new(mCCNx);
+void
+nsCCNxTransport::SetPriority(PRInt32 priority) {
+  MutexAutoLock lock(mLock);
+  mPriority = priority;
+}
 
-  // initialize interest template (mCCNxTmpl)
-  CCNX_MakeTemplate(0);
+bool
+nsCCNxTransport::AdmitLocked() {
+  // a reader of mInput itself buffers nothing of ours
+  if (!mBudget || !mSegments)
+    return true;
+  if (!mBudget->Admit(this, mPriority, mSegments->Bytes())) {
+    mThrottled = true;
+    return false;
+  }
+  return true;
+}
 
-  // initialize ccn stream
-  // XXX size of buffer is hard coded here, which must be wrong
-  // copied from ccnwget
-  // maxBufs = 4
-  // assumeFixed = 0
-  mCCNxStream = ccn_fetch_open(mCCNxFetch, mCCNxName, ccnxName, 
-                               mCCNxTmpl, 4, CCN_V_HIGHEST, 0);
+void
+nsCCNxTransport::OnBudgetAvailable() {
+  // the reader of some pipe freed a segment and may still hold the monitor
+  // of its pipe, so don't touch ours from here
+  nsCOMPtr<nsIRunnable> event =
+    NS_NewRunnableMethod(this, &nsCCNxTransport::OnBudgetReady);
+  if (!mService || NS_FAILED(mService->Dispatch(event, NS_DISPATCH_NORMAL)))
+    NS_WARNING("can't wake up a throttled ccnx transport");
+}
 
-  mCCNxOnline = true;
-  return NS_OK;
+void
+nsCCNxTransport::OnBudgetReady() {
+  {
+    MutexAutoLock lock(mLock);
+    if (!mThrottled)
+      return;
+    mThrottled = false;
+    if (mSuspendCount)
+      return;
+  }
+  LOG(("nsCCNxTransport::OnBudgetReady [this=%p]\n", this));
+  mInput.OnCCNxReady(NS_OK);
+}
+
+void
+nsCCNxTransport::OnFetchReady() {
+  {
+    MutexAutoLock lock(mLock);
+    mReadable = true;
+  }
+  mInput.OnCCNxReady(NS_OK);
+}
+
+void
+nsCCNxTransport::RecordTelemetry() {
+  PRUint32 objects = mInput.EstimatedObjects();
+  PRUint32 timeouts = mInput.TimeoutCount();
+  if (objects + timeouts == 0)
+    return;
+
+  // a stream cut short says little about the transfer rate. empty content
+  // completes without a response ever being read.
+  if (mCCNxComplete && !mTimings.mRequestStart.IsNull() &&
+      !mTimings.mResponseEnd.IsNull())
+    nsCCNxTelemetry::AccumulateThroughput(
+      mInput.ByteCount(), mTimings.mResponseEnd - mTimings.mRequestStart);
+
+  PRUint32 rate = objects ? NS_MIN<PRUint32>(timeouts * 100 / objects, 100)
+                          : 100;
+  nsCCNxTelemetry::Accumulate(nsCCNxTelemetry::TIMEOUT_RATE, rate);
+}
+
+void
+nsCCNxTransport::GetTimings(nsCCNxTimings *result) {
+  MutexAutoLock lock(mLock);
+  *result = mTimings;
+}
+
+void
+nsCCNxTransport::GetSnapshot(nsCCNxStreamSnapshot *result) {
+  MutexAutoLock lock(mLock);
+  result->mName = mCCNxURI;
+  result->mBytesRead = mInput.ByteCount();
+  result->mWindow = WindowLocked();
+  result->mBuffered = mSegments ? mSegments->Bytes() : 0;
+  result->mPriority = mPriority;
+  result->mSuspended = mSuspendCount > 0;
+  result->mThrottled = mThrottled;
 }
 
 NS_IMETHODIMP
@@ -132,20 +294,25 @@ nsCCNxTransport::OpenInputStream(PRUint32 flags,
     bool openBlocking = (flags & OPEN_BLOCKING);
 
     net_ResolveSegmentParams(segsize, segcount);
-    // currently, we only use system allocator
-    // nsIMemory *segalloc = net_GetSegmentAlloc(segsize);
+    // use the recycling pool of the protocol handler when the segments fit
     nsIMemory *segalloc = nsnull;
+    if (segsize == CCNX_SEGMENT_SIZE && gCCNxHandler)
+      segalloc = gCCNxHandler->SegmentAlloc();
+    // the segments of the pipe are what we buffer: the pipe frees them as
+    // the reader is done with them, which credits the buffer budget.
+    mSegments = new nsCCNxBudgetedSegments(mBudget, segalloc, segsize);
 
     // create a pipe
-    nsCOMPtr<nsIAsyncOutputStream> pipeOut;
-    rv = NS_NewPipe2(getter_AddRefs(pipeIn), getter_AddRefs(pipeOut),
-                     !openBlocking, true, segsize, segcount, segalloc);
+    rv = NS_NewPipe2(getter_AddRefs(pipeIn), getter_AddRefs(mPipeOut),
+                     !openBlocking, true, segsize, segcount, mSegments);
+    if (NS_FAILED(rv)) return rv;
+    // we fill the pipe ourselves on the transport thread: ccn_fetch_read
+    // writes straight into the pipe segments from OnOutputStreamReady, and
+    // the reader at the other side gets the pipe's own notifications.
+    rv = mPipeOut->AsyncWait(this, 0, 0, mService);
     if (NS_FAILED(rv)) return rv;
-    // no callback for NS_AsyncCopy, the output will be directly push into the 
-    // pipe the thread at the other size of the pipe (pipeOut's OnInputStreamReady)
-    // should deal with callback.
-    rv = NS_AsyncCopy(&mInput, pipeOut, mService,
-                      NS_ASYNCCOPY_VIA_WRITESEGMENTS, segsize);
+    // the transport thread is about to express the first Interests
+    SendStatus(nsISocketTransport::STATUS_WAITING_FOR);
 
     *result = pipeIn;
 
@@ -172,68 +339,242 @@ NS_IMETHODIMP
 nsCCNxTransport::Close(nsresult reason) {
   if (NS_SUCCEEDED(reason))
     reason = NS_BASE_STREAM_CLOSED;
+  nsCCNxTrace::Record(nsCCNxTrace::CLOSE, this, PRUint32(reason));
+  // bytes read since the last STATUS_READING, before the sink goes away
+  SendStatus(nsITransport::STATUS_READING, true);
 
   mInput.CloseWithStatus(reason);
   mInputClosed = true;
+  if (mPipeOut)
+    mPipeOut->CloseWithStatus(reason);
+
+  // whatever is left in the pipe goes back to the budget with the pipe
+  {
+    MutexAutoLock lock(mLock);
+    mThrottled = false;
+    // the sink usually holds on to whoever holds us
+    mEventSink = nsnull;
+  }
+  ReleaseCCNx(reason);
+  if (mBudget)
+    mBudget->Withdraw(this);
+  return NS_OK;
+}
+
+void
+nsCCNxTransport::ReleaseCCNx(nsresult reason) {
+  bool wasOnline;
+  {
+    MutexAutoLock lock(mLock);
+    // drop our reference on the fetch stream. unless a reader is inside
+    // ccn_fetch_read, this hands it to the driver to close right away,
+    // which drops the Interests still pending for this request; otherwise
+    // the reader does it once it is done.
+    wasOnline = mCCNxOnline;
+    if (mCCNxOnline) {
+      mCCNxOnline = false;
+      CCNX_ReleaseLocked(mFetchStream);
+    }
+  }
+  // this may come more than once, the stream ends the first time
+  if (!wasOnline)
+    return;
+  if (mRecorder)
+    mRecorder->StreamClosed(this, reason);
+  if (mStats)
+    mStats->RemoveStream(this);
+}
+
+//-----------------------------------------------------------------------------
+// nsIOutputStreamCallback Methods
+
+namespace {
+
+struct FillState {
+  nsCCNxInputStream                *mInput;
+  // the pipe swallows errors of the segment writer, keep them here
+  nsresult                          mSourceCondition;
+};
+
+NS_METHOD
+FillPipeSegment(nsIOutputStream *aOutStream, void *aClosure,
+                char *aToSegment, PRUint32 aFromOffset, PRUint32 aCount,
+                PRUint32 *aReadCount) {
+  SAMPLE_LABEL("CCNx", "FillPipeSegment");
+  FillState *state = static_cast<FillState*>(aClosure);
+  nsCCNxInputStream *input = state->mInput;
+  // the first bytes of the content go out as soon as they are here
+  bool gather = input->ByteCount() > 0;
+
+  state->mSourceCondition = input->Read(aToSegment, aCount, aReadCount);
+  if (NS_FAILED(state->mSourceCondition) || *aReadCount == 0 || !gather)
+    return state->mSourceCondition;
+
+  // every write wakes up the reader, so gather small ContentObjects into
+  // the segment until it is full or CCNX_FILL_DELAY is over. whatever
+  // stopped us is reported again by the next Read.
+  PRUint32 filled = *aReadCount;
+  PRIntervalTime start = PR_IntervalNow();
+  PRIntervalTime delay = PR_MillisecondsToInterval(CCNX_FILL_DELAY);
+  while (filled < aCount) {
+    PRIntervalTime elapsed = PR_IntervalNow() - start;
+    if (elapsed >= delay)
+      break;
+    PRUint32 n;
+    nsresult rv = input->ReadWithin(aToSegment + filled, aCount - filled,
+                                    &n, delay - elapsed);
+    if (NS_FAILED(rv) || n == 0)
+      break;
+    filled += n;
+  }
+  *aReadCount = filled;
+  return NS_OK;
+}
+
+} // anonymous namespace
+
+NS_IMETHODIMP
+nsCCNxTransport::OnOutputStreamReady(nsIAsyncOutputStream *aOutStream) {
+  SAMPLE_LABEL("CCNx", "nsCCNxTransport::OnOutputStreamReady");
+  // called on the transport thread whenever the pipe has room; ccn_fetch
+  // reads the segments straight into the pipe buffers.
+  FillState state = { &mInput, NS_OK };
+  nsresult rv;
+  PRUint32 n;
+  for (;;) {
+    state.mSourceCondition = NS_OK;
+    rv = aOutStream->WriteSegments(FillPipeSegment, &state,
+                                   CCNX_SEGMENT_SIZE, &n);
+    if (NS_FAILED(rv) || NS_FAILED(state.mSourceCondition) || n == 0)
+      break;
+    SendStatus(nsITransport::STATUS_READING);
+  }
+
+  if (rv == NS_BASE_STREAM_WOULD_BLOCK) {
+    // the pipe is full, wait for the reader to drain it
+    aOutStream->AsyncWait(this, 0, 0, mService);
+  } else if (NS_FAILED(rv)) {
+    // the reader went away. a blocking reader has nobody to close us for
+    // it, and closing twice is harmless.
+    Close(rv);
+  } else if (state.mSourceCondition == NS_BASE_STREAM_WOULD_BLOCK) {
+    // nothing to read yet, or the Interest window is closed. the driver
+    // (or Resume) calls OnInputStreamReady once that changes, and the
+    // thread serves other streams meanwhile.
+    mInput.AsyncWait(this, 0, 0, nsnull);
+  } else if (NS_FAILED(state.mSourceCondition)) {
+    // as above, nobody may be left to close us
+    Close(state.mSourceCondition);
+  } else {
+    // end of content: the reader drains the pipe by itself, but the
+    // connection can go back to the pool right away. a blocking reader
+    // never closes the transport, so this is where its connection goes.
+    // the final count is reported whatever the interval.
+    SendStatus(nsITransport::STATUS_READING, true);
+    aOutStream->Close();
+    ReleaseCCNx(NS_BASE_STREAM_CLOSED);
+  }
+  return NS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// nsIInputStreamCallback Methods
+
+NS_IMETHODIMP
+nsCCNxTransport::OnInputStreamReady(nsIAsyncInputStream *aInStream) {
+  // the window reopened (or the input was closed): go back to filling the
+  // pipe on the transport thread
+  if (mPipeOut)
+    mPipeOut->AsyncWait(this, 0, 0, mService);
   return NS_OK;
 }
 
 NS_IMETHODIMP
 nsCCNxTransport::SetEventSink(nsITransportEventSink *sink,
                               nsIEventTarget *target) {
-  return NS_ERROR_NOT_IMPLEMENTED;
+  // copied from nsSocketTransport::SetEventSink, but events that pile up
+  // on the target are coalesced: only the latest progress matters.
+  nsCOMPtr<nsITransportEventSink> temp;
+  if (target) {
+    nsresult rv = net_NewTransportEventSinkProxy(getter_AddRefs(temp),
+                                                 sink, target, true);
+    if (NS_FAILED(rv))
+      return rv;
+    sink = temp.get();
+  }
+
+  MutexAutoLock lock(mLock);
+  mEventSink = sink;
+  return NS_OK;
+}
+
+void
+nsCCNxTransport::SendStatus(nsresult status, bool force) {
+  nsCOMPtr<nsITransportEventSink> sink;
+  PRUint64 progress = 0;
+  {
+    MutexAutoLock lock(mLock);
+    if (!mEventSink)
+      return;
+    if (status == nsITransport::STATUS_READING) {
+      progress = mInput.ByteCount();
+      if (progress == mProgressReported)
+        return;
+      PRIntervalTime now = PR_IntervalNow();
+      if (!force && mProgressReported &&
+          PRIntervalTime(now - mLastProgress) <
+          PR_MillisecondsToInterval(CCNX_PROGRESS_INTERVAL))
+        return;
+      mLastProgress = now;
+      mProgressReported = progress;
+    }
+    sink = mEventSink;
+  }
+  // the length of CCNx content isn't known up front
+  sink->OnTransportStatus(this, status, progress, LL_MAXUINT);
 }
 
 void 
 nsCCNxTransport::CCNX_MakeTemplate(int allow_stale) {
-  mCCNxTmpl = ccn_charbuf_create();
-  ccn_charbuf_append_tt(mCCNxTmpl, CCN_DTAG_Interest, CCN_DTAG);
-  ccn_charbuf_append_tt(mCCNxTmpl, CCN_DTAG_Name, CCN_DTAG);
-  ccn_charbuf_append_closer(mCCNxTmpl); /* </Name> */
-  // XXX - use pubid if possible
-  ccn_charbuf_append_tt(mCCNxTmpl, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
-  ccnb_append_number(mCCNxTmpl, 1);
-  ccn_charbuf_append_closer(mCCNxTmpl); /* </MaxSuffixComponents> */
-  if (allow_stale) {
-    ccn_charbuf_append_tt(mCCNxTmpl, CCN_DTAG_AnswerOriginKind, CCN_DTAG);
-    ccnb_append_number(mCCNxTmpl, CCN_AOK_DEFAULT | CCN_AOK_STALE);
-    ccn_charbuf_append_closer(mCCNxTmpl); /* </AnswerOriginKind> */
-  }
-  ccn_charbuf_append_closer(mCCNxTmpl); /* </Interest> */
+  // copy the prebuilt image instead of encoding the template every time
+  struct ccn_charbuf *tmpl = mFetchStream->mTmpl;
+  ccn_charbuf_reset(tmpl);
+  PRInt32 scope = CCNX_SCOPE_ANY;
+  PRUint32 lifetime = CCNX_LIFETIME_ANY;
+  if (gCCNxHandler) {
+    scope = gCCNxHandler->InterestScope();
+    lifetime = gCCNxHandler->InterestLifetime();
+  }
+  mFetchStream->mScope = scope;
+  mFetchStream->mLifetime = lifetime;
+  nsCCNxInterestTemplate::Append(tmpl, allow_stale != 0, scope, lifetime);
 }
 
 void
 nsCCNxTransport::CCNX_Close() {
-  // XXX what if mCCNxStream has not been initialized yet?
-  mCCNxStream = ccn_fetch_close(mCCNxStream);
-  mCCNxFetch = ccn_fetch_destroy(mCCNxFetch);
-  ccn_destroy(&mCCNx);
-  ccn_charbuf_destroy(&mCCNxName);
-  ccn_charbuf_destroy(&mCCNxTmpl);
+  // keep the connection for the next request if we read the whole content
+  mStatePool->Close(mFetchStream, mCCNxComplete);
 
   // TODO put the 'mInputClosed' into the right place
   mInputClosed = true;
 }
 
-struct ccn_fetch_stream*
+nsCCNxFetchStream *
 nsCCNxTransport::CCNX_GetLocked() {
-  // mCCNx is not available to the streams while it's not oneline
+  // the stream is not available to the readers while it's not online
   if (!mCCNxOnline)
     return nsnull;
 
-  if (mCCNxStream)
-    mCCNxRef++;
-
-  return mCCNxStream;
+  mCCNxRef++;
+  return mFetchStream;
 }
 
 void
-nsCCNxTransport::CCNX_ReleaseLocked(struct ccn_fetch_stream *ccnfs) {
-  NS_ASSERTION(mCCNxStream == ccnfs, "wrong ndn");
+nsCCNxTransport::CCNX_ReleaseLocked(nsCCNxFetchStream *stream) {
+  NS_ASSERTION(mFetchStream == stream, "wrong ndn");
 
   if (--mCCNxRef == 0) {
     // close ndn here
     CCNX_Close();
   }
 }
-
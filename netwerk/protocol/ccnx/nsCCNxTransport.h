@@ -41,11 +41,18 @@
 
 #include "nsCCNxInputStream.h"
 #include "nsCCNxTransportService.h"
+#include "nsCCNxBufferBudget.h"
+#include "nsCCNxFetchState.h"
+#include "nsCCNxURL.h"
+#include "nsCCNxStats.h"
+#include "nsCCNxRecorder.h"
 
 #include "mozilla/Mutex.h"
+#include "mozilla/TimeStamp.h"
 #include "nsIAsyncInputStream.h"
 #include "nsIAsyncOutputStream.h"
 #include "nsITransport.h"
+#include "nsCOMPtr.h"
 
 extern "C" {
 #include <ccn/ccn.h>
@@ -54,47 +61,150 @@ extern "C" {
 #include <ccn/fetch.h>
 }
 
-class nsCCNxTransport : public nsITransport {
+// Pipe segment size used for CCNx loads, matching the payload size of a
+// CCNx ContentObject (CCN_CHUNK_SIZE) so each segment read fills one pipe
+// segment, and number of such segments kept around for reuse.
+#define CCNX_SEGMENT_SIZE 4096
+#define CCNX_SEGMENT_POOL_COUNT 64
+
+// Minimum time in ms between two STATUS_READING events of a transport.
+#define CCNX_PROGRESS_INTERVAL 100
+
+// Milestones of a CCNx transport, reported through nsITimedChannel. Each
+// stays null until it is reached.
+struct nsCCNxTimings {
+  // getting a connection to ccnd
+  mozilla::TimeStamp                mConnectStart;
+  mozilla::TimeStamp                mConnectEnd;
+  // the driver opened the fetch stream: the version is resolved and the
+  // Interest for the first segment is out. seen by the first read after.
+  mozilla::TimeStamp                mRequestStart;
+  // first and latest ContentObject read
+  mozilla::TimeStamp                mResponseStart;
+  mozilla::TimeStamp                mResponseEnd;
+};
+
+class nsCCNxTransport : public nsITransport
+                      , public nsIInputStreamCallback
+                      , public nsIOutputStreamCallback {
   typedef mozilla::Mutex Mutex;
 
 public:
   NS_DECL_ISUPPORTS
   NS_DECL_NSITRANSPORT
+  NS_DECL_NSIINPUTSTREAMCALLBACK
+  NS_DECL_NSIOUTPUTSTREAMCALLBACK
 
   nsCCNxTransport();
   virtual ~nsCCNxTransport();
 
   // this method instructs the CCNx transport to open a transport of a
-  // given type(s) to the given name
-  nsresult Init(const char *ccnxName);
+  // given type(s) to the name of the given URL
+  nsresult Init(nsCCNxURL *url);
+
+  // Suspend and Resume are called on the main thread by nsCCNxCore. While
+  // suspended, the Interest window of the stream is zero: the input stream
+  // stops calling into ccn_fetch, so no more Interests are expressed and at
+  // most one window of segments stays buffered inside libccn.
+  void Suspend();
+  void Resume();
+
+  // Priority of the stream when the buffer budget runs low, one of the
+  // nsISupportsPriority values.
+  void SetPriority(PRInt32 priority);
+
+  // Called by nsCCNxBufferBudget once this throttled stream may read again,
+  // on any thread. Goes on with the transport on its thread.
+  void OnBudgetAvailable();
+
+  // Called on the driver thread of nsCCNxFetchStatePool once the fetch
+  // stream has something to read after a read found nothing.
+  void OnFetchReady();
+
+  // Copies the milestones reached so far, from any thread.
+  void GetTimings(nsCCNxTimings *result);
+
+  // For the stream table of nsCCNxStats.
+  void GetSnapshot(nsCCNxStreamSnapshot *result);
 
 private:
 
+  // number of segment Interests the stream may keep outstanding, zero while
+  // the transport is suspended or throttled by the buffer budget.
+  // called with mLock held.
+  PRUint32 WindowLocked() {
+    return (mSuspendCount || mThrottled) ? 0 : mMaxWindow;
+  }
+
+  // Called by the reader before pulling a segment; closes the window when
+  // the buffer budget is exhausted. called with mLock held.
+  bool AdmitLocked();
+
+  // the event of OnBudgetAvailable
+  void OnBudgetReady();
+
+  // reports |status| to the event sink. STATUS_READING is sent at most
+  // every CCNX_PROGRESS_INTERVAL ms unless |force| is set.
+  void SendStatus(nsresult status, bool force = false);
+
+  // throughput and timeout rate of the stream, once no reader is left
+  void RecordTelemetry();
+
+  // drops the reference of the transport on the connection, once the
+  // content is read or the transport is closed.
+  void ReleaseCCNx(nsresult reason);
+
   void CCNX_Close();
   void CCNX_MakeTemplate(int allow_stale);
   //
   // mCCNx access methods: called with mLock held.
   //
-  struct ccn_fetch_stream *CCNX_GetLocked();
-  void CCNX_ReleaseLocked(struct ccn_fetch_stream* ccnfs);
+  nsCCNxFetchStream *CCNX_GetLocked();
+  void CCNX_ReleaseLocked(nsCCNxFetchStream *stream);
 
 private:
 
   Mutex                             mLock;
-  // connector to ccnd
-  struct ccn                       *mCCNx;
-  struct ccn_fetch                 *mCCNxFetch;
-  struct ccn_charbuf               *mCCNxName;
-  struct ccn_charbuf               *mCCNxTmpl;
-  struct ccn_fetch_stream          *mCCNxStream;
+  // the fetch stream on a connection taken from mStatePool
+  nsRefPtr<nsCCNxFetchStream>       mFetchStream;
+  // canonical ccnx: form of the name, identifies the fetch stream
+  nsCString                         mCCNxURI;
 
   // mCCNx is closed when mFDref goes to zero
   nsrefcnt                          mCCNxRef;
   bool                              mCCNxOnline;
+  // the fetch stream reached the end of the content
+  bool                              mCCNxComplete;
   bool                              mInputClosed;
 
+  // access to these is protected by mLock
+  PRUint32                          mMaxWindow;
+  PRUint32                          mSuspendCount;
+  bool                              mThrottled;
+  // the driver found something to read since the last read
+  bool                              mReadable;
+  PRInt32                           mPriority;
+  nsRefPtr<nsCCNxBufferBudget>      mBudget;
+  // segments of the pipe, the bytes read from ccnd that the channel hasn't
+  // consumed yet. null for a reader of mInput itself.
+  nsRefPtr<nsCCNxBudgetedSegments>  mSegments;
+  nsRefPtr<nsCCNxFetchStatePool>    mStatePool;
+  nsRefPtr<nsCCNxStats>             mStats;
+  // null unless loads are being recorded
+  nsRefPtr<nsCCNxRecorder>          mRecorder;
+  // progress reporting, protected by mLock
+  nsCOMPtr<nsITransportEventSink>   mEventSink;
+  PRIntervalTime                    mLastProgress;
+  PRUint64                          mProgressReported;
+  // protected by mLock
+  nsCCNxTimings                     mTimings;
+
   nsCCNxInputStream                 mInput;
-  nsCCNxTransportService*           mService;
+  // write end of the pipe handed out by OpenInputStream, filled from mInput
+  // on the transport thread
+  nsCOMPtr<nsIAsyncOutputStream>    mPipeOut;
+  // the threads shared by all transports, owned by the protocol handler
+  nsRefPtr<nsCCNxTransportService>  mService;
 
   friend class nsCCNxInputStream;
 };
@@ -37,6 +37,8 @@
  * ***** END LICENSE BLOCK ***** */
 
 #include "nsCCNxTransportService.h"
+#include "nsXPCOMCIDInternal.h"
+#include "nsComponentManagerUtils.h"
 
 using namespace mozilla;
 
@@ -45,44 +47,33 @@ extern PRLogModuleInfo* gCCNxLog;
 #endif
 #define LOG(args)         PR_LOG(gCCNxLog, PR_LOG_DEBUG, args)
 
-NS_IMPL_THREADSAFE_ISUPPORTS2(nsCCNxTransportService,
-                              nsIEventTarget,
-                              nsIRunnable)
+// idle threads are let go after this many ms
+#define CCNX_THREAD_IDLE_TIMEOUT (30 * 1000)
 
-/*
-NS_IMPL_THREADSAFE_ADDREF(nsCCNxTransportService)
-NS_IMPL_THREADSAFE_RELEASE(nsCCNxTransportService)
-
-NS_INTERFACE_MAP_BEGIN(nsCCNxTransportService)
-  NS_INTERFACE_MAP_ENTRY(nsIEventTarget)
-  NS_INTERFACE_MAP_ENTRY(nsIRunnable)
-  NS_INTERFACE_MAP_ENTRY_AMBIGUOUS(nsISupports)
-NS_INTERFACE_MAP_END_THREADSAFE;
-*/
-
-//-----------------------------------------------------------------------------
-// nsIEVentTarget Methods
+NS_IMPL_THREADSAFE_ISUPPORTS1(nsCCNxTransportService, nsIEventTarget)
 
 nsCCNxTransportService::nsCCNxTransportService()
-    : mLock("nsCCNxTransportService.mLock")
-    , mInitialized(false)
-    , mShuttingDown(false) {
+    : mLock("nsCCNxTransportService.mLock") {
   LOG(("nsCCNxTransportService created @%p\n", this));
 }
 
 nsCCNxTransportService::~nsCCNxTransportService() {
+  NS_ASSERTION(!mPool, "not shut down");
   LOG(("nsCCNxTransportService destroyed @%p\n", this));
 }
 
+//-----------------------------------------------------------------------------
+// nsIEventTarget Methods
+
 NS_IMETHODIMP
 nsCCNxTransportService::Dispatch(nsIRunnable *event, PRUint32 flags) {
   LOG(("nsCCNxTransportService dispatch [%p]\n", event));
 
-  nsCOMPtr<nsIThread> thread = GetThreadSafely();
-  NS_ENSURE_TRUE(thread, NS_ERROR_NOT_INITIALIZED);
-  nsresult rv = thread->Dispatch(event, flags);
+  nsCOMPtr<nsIThreadPool> pool = GetPoolSafely();
+  NS_ENSURE_TRUE(pool, NS_ERROR_NOT_INITIALIZED);
+  nsresult rv = pool->Dispatch(event, flags);
   if (rv == NS_ERROR_UNEXPECTED) {
-    // Thread is no longer accepting events. We must have just shut it
+    // Pool is no longer accepting events. We must have just shut it
     // down on the main thread. Pretend we never saw it.
     rv = NS_ERROR_NOT_INITIALIZED;
   }
@@ -91,118 +82,70 @@ nsCCNxTransportService::Dispatch(nsIRunnable *event, PRUint32 flags) {
 
 NS_IMETHODIMP
 nsCCNxTransportService::IsOnCurrentThread(bool *result) {
-  nsCOMPtr<nsIThread> thread = GetThreadSafely();
-  NS_ENSURE_TRUE(thread, NS_ERROR_NOT_INITIALIZED);
-  return thread->IsOnCurrentThread(result);
-}
-
-NS_IMETHODIMP
-nsCCNxTransportService::Run() {
-  LOG(("nsCCNxTransportService @%p, start running\n", this));
-  // Add self reference
-  nsIThread *thread = NS_GetCurrentThread();
-
-  for (;;) {
-    bool pendingEvents = false;
-    bool shuttingSignal = false;
-    thread->HasPendingEvents(&pendingEvents);
-
-    do {
-      // If there are pending events for this thread then
-      // DoPollIteration() should service the network without blocking.
-      //DoPollIteration(!pendingEvents);
-            
-      // If nothing was pending before the poll, it might be now
-      if (!pendingEvents)
-        thread->HasPendingEvents(&pendingEvents);
-
-      if (pendingEvents) {
-        NS_ProcessNextEvent(thread);
-        pendingEvents = false;
-        thread->HasPendingEvents(&pendingEvents);
-      }
-    } while (pendingEvents);
-
-    // now that our event queue is empty, check to see if we should exit
-    mLock.Lock();
-    shuttingSignal = mShuttingDown;
-    mLock.Unlock();
-    if (shuttingSignal) {
-      LOG(("nsCCNxTransportService @%p, is shutting down\n", this));
-      break;
-    }
-  }
-  LOG(("nsCCNxTransportService @%p, stop running\n", this));
-  return NS_OK;
+  nsCOMPtr<nsIThreadPool> pool = GetPoolSafely();
+  NS_ENSURE_TRUE(pool, NS_ERROR_NOT_INITIALIZED);
+  return pool->IsOnCurrentThread(result);
 }
 
 //-----------------------------------------------------------------------------
 // public Methods
-NS_IMETHODIMP
+
+nsresult
 nsCCNxTransportService::Init() {
   if (!NS_IsMainThread()) {
     NS_ERROR("wrong thread");
     return NS_ERROR_UNEXPECTED;
   }
 
-  if (mInitialized)
+  if (mPool)
     return NS_OK;
 
-  if (mShuttingDown)
-    return NS_ERROR_UNEXPECTED;
-
-  //  nsCOMPtr<nsIThread> thread;
-  //  if (NS_FAILED(rv)) return rv;
-    
   nsresult rv;
-  {
-    MutexAutoLock lock(mLock);
-    // Install our mThread, protecting against concurrent readers
-    rv = NS_NewThread(getter_AddRefs(mThread), this);
-    if (NS_FAILED(rv)) return rv;
-  }
-
-  mInitialized = true;
+  nsCOMPtr<nsIThreadPool> pool = do_CreateInstance(NS_THREADPOOL_CONTRACTID,
+                                                   &rv);
+  if (NS_FAILED(rv))
+    return rv;
+  pool->SetThreadLimit(CCNX_TRANSPORT_THREADS);
+  pool->SetIdleThreadLimit(1);
+  pool->SetIdleThreadTimeout(CCNX_THREAD_IDLE_TIMEOUT);
+
+  MutexAutoLock lock(mLock);
+  // Install our mPool, protecting against concurrent readers
+  mPool = pool;
   return NS_OK;
 }
 
-NS_IMETHODIMP
+nsresult
 nsCCNxTransportService::Shutdown() {
   // called from the Main thread
   NS_ENSURE_STATE(NS_IsMainThread());
-  if (!mInitialized)
-    return NS_OK;
 
-  if (mShuttingDown)
-    return NS_ERROR_UNEXPECTED;
-  
+  nsCOMPtr<nsIThreadPool> pool;
   {
     MutexAutoLock lock(mLock);
-
-    // signal the socket thread to shutdown
-    mShuttingDown = true;
+    // from now on Dispatch fails
+    pool.swap(mPool);
   }
+  if (!pool)
+    return NS_OK;
 
-  // join with thread
-  //  mThread->Shutdown();
-  mThread = nsnull;
-  
-  LOG(("nsCCNxTransportService @%p, main thread shut me down\n", this));
-  mInitialized = false;
-  mShuttingDown = false;
+  // join with the threads, running the events already queued. readers
+  // never wait on the network for longer than CCNX_FILL_DELAY.
+  pool->Shutdown();
 
+  LOG(("nsCCNxTransportService @%p, main thread shut me down\n", this));
   return NS_OK;
 }
 
 //-----------------------------------------------------------------------------
 // private Methods
 
-already_AddRefed<nsIThread>
-nsCCNxTransportService::GetThreadSafely() {
-  nsIThread* result;
-  {  
+already_AddRefed<nsIThreadPool>
+nsCCNxTransportService::GetPoolSafely() {
+  nsIThreadPool* result;
+  {
     MutexAutoLock lock(mLock);
-    result = mThread;
+    result = mPool;
     NS_IF_ADDREF(result);
   }
   return result;
@@ -40,32 +40,41 @@
 #define nsCCNxTransportService_h__
 
 #include "nsIEventTarget.h"
-#include "nsIRunnable.h"
+#include "nsIThreadPool.h"
 #include "nsThreadUtils.h"
+#include "nsCOMPtr.h"
 #include "mozilla/Mutex.h"
 
-class nsCCNxTransportService : public nsIEventTarget,
-                               public nsIRunnable {
+// Most threads the transports fill their pipes on, whatever the number of
+// open streams.
+#define CCNX_TRANSPORT_THREADS 8
+
+/**
+ * The threads the CCNx transports run ccn_fetch on, shared by all of them
+ * and owned by the protocol handler. A transport reads what the driver of
+ * nsCCNxFetchStatePool brought in and waits for the driver to dispatch it
+ * again, so a stream waiting on the network doesn't hold a thread.
+ *
+ * Init and Shutdown are main thread only; Shutdown joins the threads.
+ */
+class nsCCNxTransportService : public nsIEventTarget {
   typedef mozilla::Mutex Mutex;
 
 public:
   NS_DECL_ISUPPORTS
   NS_DECL_NSIEVENTTARGET
-  NS_DECL_NSIRUNNABLE
 
   nsCCNxTransportService();
   virtual ~nsCCNxTransportService();
-  NS_IMETHODIMP Init();
-  NS_IMETHODIMP Shutdown();
+  nsresult Init();
+  nsresult Shutdown();
 
 private:
 
-  already_AddRefed<nsIThread> GetThreadSafely();
+  already_AddRefed<nsIThreadPool> GetPoolSafely();
 
-  nsCOMPtr<nsIThread>        mThread;
+  nsCOMPtr<nsIThreadPool>    mPool;
   Mutex                      mLock;
-  bool                       mInitialized;
-  bool                       mShuttingDown;
 };
 
 #endif // nsCCNxTransportService_h__
@@ -0,0 +1,223 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#include "nsCCNxURL.h"
+#include "nsCCNxError.h"
+
+#include "nsAutoPtr.h"
+
+extern "C" {
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+#include <ccn/uri.h>
+}
+
+NS_IMPL_ADDREF_INHERITED(nsCCNxURL, nsStandardURL)
+NS_IMPL_RELEASE_INHERITED(nsCCNxURL, nsStandardURL)
+
+NS_INTERFACE_MAP_BEGIN(nsCCNxURL)
+  NS_INTERFACE_MAP_ENTRY(nsCCNxURL)
+NS_INTERFACE_MAP_END_INHERITING(nsStandardURL)
+
+nsCCNxURL::nsCCNxURL()
+    : nsStandardURL(false)
+    , mName(nsnull)
+    , mNameHash(0) {
+}
+
+nsCCNxURL::~nsCCNxURL() {
+  ccn_charbuf_destroy(&mName);
+}
+
+nsresult
+nsCCNxURL::FromURI(nsIURI *uri, nsCCNxURL **result) {
+  // URIs made by our protocol handler carry the parsed name already;
+  // anything else is parsed here, once.
+  nsresult rv;
+  nsRefPtr<nsCCNxURL> url = do_QueryInterface(uri);
+  if (!url) {
+    nsCAutoString spec;
+    rv = uri->GetAsciiSpec(spec);
+    if (NS_FAILED(rv))
+      return rv;
+    url = new nsCCNxURL();
+    rv = url->Init(nsIStandardURL::URLTYPE_STANDARD, -1, spec,
+                   nsnull, nsnull);
+    if (NS_FAILED(rv))
+      return rv;
+  }
+
+  const struct ccn_charbuf *name;
+  rv = url->GetCCNxName(&name);
+  if (NS_FAILED(rv))
+    return rv;
+
+  url.forget(result);
+  return NS_OK;
+}
+
+nsStandardURL*
+nsCCNxURL::StartClone() {
+  // the clone parses its name again when it is first asked for
+  nsCCNxURL *clone = new nsCCNxURL();
+  return clone;
+}
+
+nsresult
+nsCCNxURL::EnsureName() {
+  if (mName)
+    return NS_OK;
+
+  nsCAutoString spec;
+  nsresult rv = GetAsciiSpec(spec);
+  if (NS_FAILED(rv))
+    return rv;
+
+  // ccn_name_from_uri takes care of the ccnx: scheme and of the escaping.
+  // A name that doesn't parse is tried again, and fails again, next time.
+  mName = ccn_charbuf_create();
+  if (ccn_name_from_uri(mName, spec.get()) < 0) {
+    InvalidateName();
+    return NS_ERROR_CCNX_INVALID_NAME;
+  }
+
+  struct ccn_charbuf *canonical = ccn_charbuf_create();
+  ccn_uri_append(canonical, mName->buf, mName->length, 1);
+  mCanonicalName.Assign(reinterpret_cast<const char*>(canonical->buf),
+                        canonical->length);
+  ccn_charbuf_destroy(&canonical);
+
+  // FNV-1a over the ccnb bytes. A prefix is encoded as the bytes up to the
+  // start of its first dropped component and the closer of the name, so
+  // the hashes of all the prefixes come out of the same pass.
+  struct ccn_indexbuf *comps = ccn_indexbuf_create();
+  int ncomps = ccn_name_split(mName, comps);
+  if (ncomps < 0) {
+    ccn_indexbuf_destroy(&comps);
+    InvalidateName();
+    return NS_ERROR_CCNX_INVALID_NAME;
+  }
+  mPrefixHashes.SetLength(ncomps + 1);
+  PRUint32 hash = 2166136261U;
+  size_t i = 0;
+  for (int n = 0; n <= ncomps; ++n) {
+    for (; i < comps->buf[n]; ++i) {
+      hash ^= mName->buf[i];
+      hash *= 16777619U;
+    }
+    // the closer is a zero byte
+    mPrefixHashes[ncomps - n] = hash * 16777619U;
+  }
+  ccn_indexbuf_destroy(&comps);
+  mNameHash = mPrefixHashes[0];
+  return NS_OK;
+}
+
+void
+nsCCNxURL::InvalidateName() {
+  ccn_charbuf_destroy(&mName);
+}
+
+nsresult
+nsCCNxURL::GetCCNxName(const struct ccn_charbuf **name) {
+  nsresult rv = EnsureName();
+  if (NS_FAILED(rv))
+    return rv;
+  *name = mName;
+  return NS_OK;
+}
+
+nsresult
+nsCCNxURL::GetCanonicalName(nsACString &result) {
+  nsresult rv = EnsureName();
+  if (NS_FAILED(rv))
+    return rv;
+  result = mCanonicalName;
+  return NS_OK;
+}
+
+nsresult
+nsCCNxURL::GetNameHash(PRUint32 *result) {
+  nsresult rv = EnsureName();
+  if (NS_FAILED(rv))
+    return rv;
+  *result = mNameHash;
+  return NS_OK;
+}
+
+nsresult
+nsCCNxURL::GetPrefixHashes(nsTArray<PRUint32> &result) {
+  nsresult rv = EnsureName();
+  if (NS_FAILED(rv))
+    return rv;
+  result = mPrefixHashes;
+  return NS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// nsIURI and nsIURL mutators
+
+#define IMPL_NAME_SETTER(name)                                      \
+NS_IMETHODIMP                                                       \
+nsCCNxURL::name(const nsACString &input) {                          \
+  InvalidateName();                                                 \
+  return nsStandardURL::name(input);                                \
+}
+
+IMPL_NAME_SETTER(SetSpec)
+IMPL_NAME_SETTER(SetScheme)
+IMPL_NAME_SETTER(SetUserPass)
+IMPL_NAME_SETTER(SetUsername)
+IMPL_NAME_SETTER(SetPassword)
+IMPL_NAME_SETTER(SetHostPort)
+IMPL_NAME_SETTER(SetHost)
+IMPL_NAME_SETTER(SetPath)
+IMPL_NAME_SETTER(SetRef)
+IMPL_NAME_SETTER(SetFilePath)
+IMPL_NAME_SETTER(SetQuery)
+IMPL_NAME_SETTER(SetDirectory)
+IMPL_NAME_SETTER(SetFileName)
+IMPL_NAME_SETTER(SetFileBaseName)
+IMPL_NAME_SETTER(SetFileExtension)
+
+NS_IMETHODIMP
+nsCCNxURL::SetPort(PRInt32 port) {
+  InvalidateName();
+  return nsStandardURL::SetPort(port);
+}
@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef nsCCNxURL_h__
+#define nsCCNxURL_h__
+
+#include "nsStandardURL.h"
+#include "nsString.h"
+#include "nsTArray.h"
+
+struct ccn_charbuf;
+
+/* 11f071ed-856d-4052-a341-b6d97a2eeb6e */
+#define NS_CCNXURL_IID                                  \
+  { 0x11f071ed, 0x856d, 0x4052,                         \
+    {0xa3, 0x41, 0xb6, 0xd9, 0x7a, 0x2e, 0xeb, 0x6e} }
+
+/**
+ * nsCCNxURL is a standard URL which also knows the CCNx name it refers to.
+ * The name is parsed from the spec once, with ccn_name_from_uri, and the
+ * ccnb encoding, its canonical ccnx: form and a hash of it are kept for the
+ * transport and any table keyed by name. The mutators of nsStandardURL
+ * drop the cached name, which is parsed again when next asked for.
+ */
+class nsCCNxURL : public nsStandardURL {
+public:
+  NS_DECLARE_STATIC_IID_ACCESSOR(NS_CCNXURL_IID)
+  NS_DECL_ISUPPORTS_INHERITED
+
+  nsCCNxURL();
+
+  // Returns |uri| itself if it is a nsCCNxURL, or a new nsCCNxURL with the
+  // same spec (e.g. for a deserialized nsStandardURL). Fails early with
+  // NS_ERROR_CCNX_INVALID_NAME on names libccn can't parse.
+  static nsresult FromURI(nsIURI *uri, nsCCNxURL **result);
+
+  // ccnb-encoded name. NS_ERROR_CCNX_INVALID_NAME if the spec doesn't parse
+  // as a CCNx name. The buffer is owned by the URL.
+  nsresult GetCCNxName(const struct ccn_charbuf **name);
+
+  // the name in canonical ccnx: form, with the escaping of ccn_uri_append
+  nsresult GetCanonicalName(nsACString &result);
+
+  // hash of the ccnb encoding, equal names hash equal
+  nsresult GetNameHash(PRUint32 *result);
+
+  // GetNameHash of the name and of each of its prefixes, longest first:
+  // |result[0]| is the hash of the name, |result[i]| the hash of the name
+  // without its last i components, down to the empty name ccnx:/.
+  nsresult GetPrefixHashes(nsTArray<PRUint32> &result);
+
+  // nsIURI and nsIURL mutators
+  NS_IMETHOD SetSpec(const nsACString &input);
+  NS_IMETHOD SetScheme(const nsACString &input);
+  NS_IMETHOD SetUserPass(const nsACString &input);
+  NS_IMETHOD SetUsername(const nsACString &input);
+  NS_IMETHOD SetPassword(const nsACString &input);
+  NS_IMETHOD SetHostPort(const nsACString &input);
+  NS_IMETHOD SetHost(const nsACString &input);
+  NS_IMETHOD SetPort(PRInt32 port);
+  NS_IMETHOD SetPath(const nsACString &input);
+  NS_IMETHOD SetRef(const nsACString &input);
+  NS_IMETHOD SetFilePath(const nsACString &input);
+  NS_IMETHOD SetQuery(const nsACString &input);
+  NS_IMETHOD SetDirectory(const nsACString &input);
+  NS_IMETHOD SetFileName(const nsACString &input);
+  NS_IMETHOD SetFileBaseName(const nsACString &input);
+  NS_IMETHOD SetFileExtension(const nsACString &input);
+
+protected:
+  virtual ~nsCCNxURL();
+  virtual nsStandardURL* StartClone();
+
+private:
+  nsresult EnsureName();
+  void InvalidateName();
+
+  // null until parsed
+  struct ccn_charbuf               *mName;
+  nsCString                         mCanonicalName;
+  PRUint32                          mNameHash;
+  nsTArray<PRUint32>                mPrefixHashes;
+};
+
+NS_DEFINE_STATIC_IID_ACCESSOR(nsCCNxURL, NS_CCNXURL_IID)
+
+#endif // nsCCNxURL_h__
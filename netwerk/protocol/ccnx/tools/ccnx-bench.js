@@ -0,0 +1,241 @@
+/* -*- Mode: js; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Throughput and latency benchmark of ccnx: loads, run with xpcshell from
+ * the object directory against a ccnd serving the named objects, e.g. ones
+ * published with ccnputfile in sizes from 1 KB to 1 GB:
+ *
+ *   dist/bin/run-mozilla.sh dist/bin/xpcshell ccnx-bench.js \
+ *       [-n runs] [-o results.json] ccnx:/bench/1k ccnx:/bench/1m ...
+ *
+ * Each name is loaded through the IO service (NewChannel, then AsyncOpen)
+ * |runs| times, one load at a time. Per load it reports time to first byte,
+ * load time, throughput, CPU per MB, threads and heap growth, and the ccnx
+ * timeouts; all of it goes to the JSON file for comparing builds. CPU and
+ * thread counts are read from /proc and are missing on other systems.
+ * Heap growth is the change of the "explicit" memory reporter in bytes;
+ * there is no count of allocations to report, the memory reporters only
+ * know sizes. Loads that fail are counted, and kept in the JSON file, but
+ * left out of the medians.
+ */
+
+const Cc = Components.classes;
+const Ci = Components.interfaces;
+
+const ios = Cc["@mozilla.org/network/io-service;1"]
+              .getService(Ci.nsIIOService);
+const handler = ios.getProtocolHandler("ccnx")
+                   .QueryInterface(Ci.nsICCNxProtocolHandler);
+const thread = Cc["@mozilla.org/thread-manager;1"]
+                 .getService(Ci.nsIThreadManager).currentThread;
+
+function readProcFile(name) {
+  let file = Cc["@mozilla.org/file/local;1"].createInstance(Ci.nsILocalFile);
+  try {
+    file.initWithPath(name);
+    if (!file.exists())
+      return null;
+    let fstream = Cc["@mozilla.org/network/file-input-stream;1"]
+                    .createInstance(Ci.nsIFileInputStream);
+    fstream.init(file, -1, 0, 0);
+    // /proc files have no size, so read until the converter runs dry
+    let cstream = Cc["@mozilla.org/intl/converter-input-stream;1"]
+                    .createInstance(Ci.nsIConverterInputStream);
+    cstream.init(fstream, "UTF-8", 4096, 0);
+    let data = "", str = {};
+    while (cstream.readString(4096, str))
+      data += str.value;
+    cstream.close();
+    return data;
+  } catch (e) {
+    return null;
+  }
+}
+
+// user + system CPU time of the process in ms
+function cpuTime() {
+  let stat = readProcFile("/proc/self/stat");
+  if (!stat)
+    return null;
+  // the fields after the parenthesized command name; utime and stime are
+  // the 14th and 15th of the line, in clock ticks (assumed 100 per second)
+  let fields = stat.substr(stat.lastIndexOf(")") + 2).split(" ");
+  return (parseInt(fields[11]) + parseInt(fields[12])) * 10;
+}
+
+function threadCount() {
+  let status = readProcFile("/proc/self/status");
+  let m = status && status.match(/^Threads:\s*(\d+)/m);
+  return m ? parseInt(m[1]) : null;
+}
+
+function heapAllocated() {
+  let mgr = Cc["@mozilla.org/memory-reporter-manager;1"]
+              .getService(Ci.nsIMemoryReporterManager);
+  try {
+    return mgr.explicit;
+  } catch (e) {
+    return null;
+  }
+}
+
+// the data is dropped into /dev/null, so that the consumer costs as little
+// as possible
+function nullSink() {
+  let file = Cc["@mozilla.org/file/local;1"].createInstance(Ci.nsILocalFile);
+  file.initWithPath("/dev/null");
+  let stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                 .createInstance(Ci.nsIFileOutputStream);
+  stream.init(file, 0x02, -1, 0);
+  return stream;
+}
+
+function load(spec) {
+  let channel = ios.newChannel(spec, null, null);
+  let timed = channel.QueryInterface(Ci.nsITimedChannel);
+  timed.timingEnabled = true;
+
+  let bytesBefore = handler.bytesReceived;
+  let timeoutsBefore = handler.timeouts;
+  let cpuBefore = cpuTime();
+  let heapBefore = heapAllocated();
+  let maxThreads = threadCount();
+
+  let done = false, status = 0;
+  let observer = {
+    onStartRequest: function(request, context) {},
+    onStopRequest: function(request, context, aStatus) {
+      status = aStatus;
+      done = true;
+    }
+  };
+  let listener = Cc["@mozilla.org/network/simple-stream-listener;1"]
+                   .createInstance(Ci.nsISimpleStreamListener);
+  let sink = nullSink();
+  listener.init(sink, observer);
+  channel.asyncOpen(listener, null);
+
+  while (!done) {
+    thread.processNextEvent(true);
+    let threads = threadCount();
+    if (threads > maxThreads)
+      maxThreads = threads;
+  }
+  sink.close();
+
+  let bytes = handler.bytesReceived - bytesBefore;
+  let cpu = cpuTime();
+  let heap = heapAllocated();
+  let result = {
+    status: status,
+    bytes: bytes,
+    // nsITimedChannel times are in microseconds
+    ttfbMs: (timed.responseStartTime - timed.asyncOpenTime) / 1000,
+    loadMs: (timed.responseEndTime - timed.asyncOpenTime) / 1000,
+    timeouts: handler.timeouts - timeoutsBefore,
+    maxThreads: maxThreads,
+    heapGrowth: (heap !== null && heapBefore !== null) ? heap - heapBefore
+                                                       : null
+  };
+  let transferMs = (timed.responseEndTime - timed.requestStartTime) / 1000;
+  result.throughputKBps = transferMs > 0 ? bytes / transferMs : null;
+  result.cpuMsPerMB = (cpu !== null && bytes > 0) ?
+                      (cpu - cpuBefore) / (bytes / (1024 * 1024)) : null;
+  return result;
+}
+
+function median(values) {
+  values = values.filter(function(v) { return v !== null; })
+                 .sort(function(a, b) { return a - b; });
+  return values.length ? values[values.length >> 1] : null;
+}
+
+function run(args) {
+  let runs = 5, output = null, names = [];
+  for (let i = 0; i < args.length; ++i) {
+    if (args[i] == "-n")
+      runs = parseInt(args[++i]);
+    else if (args[i] == "-o")
+      output = args[++i];
+    else
+      names.push(args[i]);
+  }
+  if (!names.length) {
+    dump("usage: ccnx-bench.js [-n runs] [-o results.json] ccnx:/name ...\n");
+    return;
+  }
+
+  let results = { date: Date.now(), runs: runs, names: [] };
+  names.forEach(function(spec) {
+    let loads = [];
+    for (let i = 0; i < runs; ++i)
+      loads.push(load(spec));
+    // a failed load stops early and would pull the medians down
+    let succeeded = loads.filter(function(l) {
+      return Components.isSuccessCode(l.status);
+    });
+    let summary = { name: spec, loads: loads,
+                    failed: loads.length - succeeded.length };
+    ["bytes", "ttfbMs", "loadMs", "throughputKBps", "cpuMsPerMB",
+     "maxThreads", "heapGrowth", "timeouts"].forEach(function(key) {
+      summary[key] = median(succeeded.map(function(l) { return l[key]; }));
+    });
+    results.names.push(summary);
+    dump(spec + ": " + summary.bytes + " bytes, first byte " +
+         summary.ttfbMs + " ms, load " + summary.loadMs + " ms, " +
+         summary.throughputKBps + " KB/s, " + summary.cpuMsPerMB +
+         " CPU ms/MB, " + summary.maxThreads + " threads, " +
+         summary.failed + " of " + loads.length + " loads failed\n");
+  });
+
+  if (output) {
+    let file = Cc["@mozilla.org/file/local;1"]
+                 .createInstance(Ci.nsILocalFile);
+    file.initWithPath(output);
+    let stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                   .createInstance(Ci.nsIFileOutputStream);
+    // write, create, truncate
+    stream.init(file, 0x02 | 0x08 | 0x20, 0644, 0);
+    let json = JSON.stringify(results, null, 2);
+    stream.write(json, json.length);
+    stream.close();
+  }
+}
+
+run(arguments);
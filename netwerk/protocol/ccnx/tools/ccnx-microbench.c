@@ -0,0 +1,294 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Microbenchmarks of the per-segment libccn work of the ccnx: transport:
+ * parsing names, building the Interest template and parsing
+ * ContentObjects, and of the per-load setup nsCCNxFetchStatePool saves.
+ * Standalone, so that it builds without the browser:
+ *
+ *   cc -O2 -o ccnx-microbench ccnx-microbench.c -lccn -lcrypto
+ *   ./ccnx-microbench [milliseconds per benchmark] [ccnd socket]
+ *
+ * Prints one tab separated line per benchmark: name, nanoseconds per
+ * operation and iterations. ContentObjects are signed with the default
+ * user key, like ccnputfile does, so ccninitkeystore must have been run.
+ * The setup benchmarks connect to the ccnd at the socket, or the default
+ * one, and are skipped if there is none; tools/fake-ccnd.py will do.
+ * Only numbers from a build against the real libccn mean anything, and
+ * none are on record yet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/fetch.h>
+#include <ccn/uri.h>
+
+/* names seen in real loads: a plain one, a versioned segment as ccn_fetch
+ * asks for it, and a long one with the version and segment markers */
+static const char *names[] = {
+  "ccnx:/ndn/ucla.edu/index.html",
+  "ccnx:/ndn/ucla.edu/apps/video/stream/%FD%05%0B%8A%A3%C2%1F/%00%01%3A",
+  "ccnx:/ndn/edu/ucla/cs/irl/papers/2012/browsing-named-data/figures/"
+    "transport-architecture.png/%FD%05%0B%8A%A3%C2%1F/%00%FE"
+};
+
+/* payload sizes: a small object, a full pipe segment, a large segment */
+static const size_t payloads[] = { 1024, 4096, 8192 };
+
+static double
+now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef void (*bench_fn)(void *closure);
+
+/* runs |fn| in growing batches until |budget_ms| is spent */
+static void
+run(const char *label, bench_fn fn, void *closure, int budget_ms) {
+  unsigned long iterations = 0, batch = 16;
+  double start = now_ns(), elapsed = 0;
+  while (elapsed < budget_ms * 1e6) {
+    unsigned long i;
+    for (i = 0; i < batch; i++)
+      fn(closure);
+    iterations += batch;
+    batch *= 2;
+    elapsed = now_ns() - start;
+  }
+  printf("%s\t%.1f\t%lu\n", label, elapsed / iterations, iterations);
+}
+
+/* ccn_name_from_uri, as nsCCNxURL does for every new spec */
+
+static void
+bench_name_from_uri(void *closure) {
+  static struct ccn_charbuf *name;
+  if (!name)
+    name = ccn_charbuf_create();
+  name->length = 0;
+  if (ccn_name_from_uri(name, (const char *)closure) < 0)
+    abort();
+}
+
+/* the Interest template, encoded element by element as the transport used
+ * to for every request, and copied from the prebuilt image as
+ * nsCCNxInterestTemplate::Append does now */
+
+static void
+encode_template(struct ccn_charbuf *c) {
+  ccn_charbuf_append_tt(c, CCN_DTAG_Interest, CCN_DTAG);
+  ccn_charbuf_append_tt(c, CCN_DTAG_Name, CCN_DTAG);
+  ccn_charbuf_append_closer(c); /* </Name> */
+  ccn_charbuf_append_tt(c, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
+  ccnb_append_number(c, 1);
+  ccn_charbuf_append_closer(c); /* </MaxSuffixComponents> */
+  ccn_charbuf_append_closer(c); /* </Interest> */
+}
+
+static void
+bench_template_encode(void *closure) {
+  struct ccn_charbuf *tmpl = closure;
+  tmpl->length = 0;
+  encode_template(tmpl);
+}
+
+struct copy_args {
+  struct ccn_charbuf *tmpl;
+  struct ccn_charbuf *image;
+};
+
+static void
+bench_template_copy(void *closure) {
+  struct copy_args *args = closure;
+  args->tmpl->length = 0;
+  ccn_charbuf_append_charbuf(args->tmpl, args->image);
+}
+
+/* ccn_parse_ContentObject and ccn_content_get_value, what ccn_fetch does
+ * for each segment that comes in */
+
+static void
+bench_parse_content(void *closure) {
+  struct ccn_charbuf *co = closure;
+  struct ccn_parsed_ContentObject pco;
+  const unsigned char *value;
+  size_t size;
+  if (ccn_parse_ContentObject(co->buf, co->length, &pco, NULL) < 0 ||
+      ccn_content_get_value(co->buf, co->length, &pco, &value, &size) < 0)
+    abort();
+}
+
+static struct ccn_charbuf *
+make_content(struct ccn *h, const char *uri, size_t size) {
+  struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+  struct ccn_charbuf *name = ccn_charbuf_create();
+  struct ccn_charbuf *co = ccn_charbuf_create();
+  unsigned char *data = calloc(1, size);
+  if (ccn_name_from_uri(name, uri) < 0 ||
+      ccn_sign_content(h, co, name, &sp, data, size) < 0) {
+    fprintf(stderr, "can't sign content, run ccninitkeystore first\n");
+    exit(1);
+  }
+  free(data);
+  ccn_charbuf_destroy(&name);
+  return co;
+}
+
+/* the setup of a load without the pool, nsCCNxFetchStatePool::Create and
+ * Destroy: a connection to ccnd, a ccn_fetch handle and the name and
+ * template buffers. Split into the connection and the rest, and compared
+ * with taking a pooled state: the liveness check of
+ * nsCCNxFetchStatePool::IsConnected and clearing the buffers */
+
+struct fetch_state {
+  struct ccn *ccnx;
+  struct ccn_fetch *fetch;
+  struct ccn_charbuf *name;
+  struct ccn_charbuf *tmpl;
+};
+
+static void
+bench_setup_connect(void *closure) {
+  struct ccn *ccnx = ccn_create();
+  if (ccn_connect(ccnx, (const char *)closure) < 0)
+    abort();
+  ccn_destroy(&ccnx);
+}
+
+static void
+bench_setup_fetch(void *closure) {
+  struct fetch_state *state = closure;
+  state->fetch = ccn_fetch_new(state->ccnx);
+  state->name = ccn_charbuf_create();
+  state->tmpl = ccn_charbuf_create();
+  state->fetch = ccn_fetch_destroy(state->fetch);
+  ccn_charbuf_destroy(&state->name);
+  ccn_charbuf_destroy(&state->tmpl);
+}
+
+static void
+bench_setup_fresh(void *closure) {
+  struct fetch_state state;
+  state.ccnx = ccn_create();
+  if (ccn_connect(state.ccnx, (const char *)closure) < 0)
+    abort();
+  bench_setup_fetch(&state);
+  ccn_destroy(&state.ccnx);
+}
+
+static void
+bench_setup_pooled(void *closure) {
+  struct fetch_state *state = closure;
+  if (ccn_run(state->ccnx, 0) < 0)
+    abort();
+  state->name->length = 0;
+  state->tmpl->length = 0;
+}
+
+static void
+bench_setup(const char *ccnd_socket, int budget) {
+  struct fetch_state state;
+  state.ccnx = ccn_create();
+  if (ccn_connect(state.ccnx, ccnd_socket) < 0) {
+    fprintf(stderr, "no ccnd at %s, skipping the setup benchmarks\n",
+            ccnd_socket ? ccnd_socket : "the default socket");
+    ccn_destroy(&state.ccnx);
+    return;
+  }
+  run("setup/connect", bench_setup_connect, (void *)ccnd_socket, budget);
+  run("setup/fetch", bench_setup_fetch, &state, budget);
+  run("setup/fresh", bench_setup_fresh, (void *)ccnd_socket, budget);
+
+  state.fetch = ccn_fetch_new(state.ccnx);
+  state.name = ccn_charbuf_create();
+  state.tmpl = ccn_charbuf_create();
+  run("setup/pooled", bench_setup_pooled, &state, budget);
+  state.fetch = ccn_fetch_destroy(state.fetch);
+  ccn_charbuf_destroy(&state.name);
+  ccn_charbuf_destroy(&state.tmpl);
+  ccn_destroy(&state.ccnx);
+}
+
+int
+main(int argc, char **argv) {
+  int budget = argc > 1 ? atoi(argv[1]) : 200;
+  const char *ccnd_socket = argc > 2 ? argv[2] : NULL;
+  char label[64];
+  size_t i;
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    snprintf(label, sizeof(label), "name_from_uri/%lu",
+             (unsigned long)strlen(names[i]));
+    run(label, bench_name_from_uri, (void *)names[i], budget);
+  }
+
+  {
+    struct copy_args args;
+    args.tmpl = ccn_charbuf_create();
+    args.image = ccn_charbuf_create();
+    encode_template(args.image);
+    run("template/encode", bench_template_encode, args.tmpl, budget);
+    run("template/copy", bench_template_copy, &args, budget);
+    ccn_charbuf_destroy(&args.tmpl);
+    ccn_charbuf_destroy(&args.image);
+  }
+
+  {
+    struct ccn *h = ccn_create();
+    for (i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+      struct ccn_charbuf *co = make_content(h, names[1], payloads[i]);
+      snprintf(label, sizeof(label), "parse_content/%lu",
+               (unsigned long)payloads[i]);
+      run(label, bench_parse_content, co, budget);
+      ccn_charbuf_destroy(&co);
+    }
+    ccn_destroy(&h);
+  }
+
+  bench_setup(ccnd_socket, budget);
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/* -*- Mode: js; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Replays loads recorded with network.ccnx.record_file, run with xpcshell
+ * from the object directory:
+ *
+ *   dist/bin/run-mozilla.sh dist/bin/xpcshell ccnx-replay.js \
+ *       [-o results.json] [-s socket] record.txt
+ *
+ * Every recorded stream is loaded again, through the IO service and the
+ * ccnd of network.ccnx.ccnd_socket (or -s), at the same offset from the
+ * first one as in the recording. The names have to be available from that
+ * ccnd. fake-ccnd.py serves them from the record itself, each segment at
+ * the time it arrived in the recording:
+ *
+ *   fake-ccnd.py --socket /tmp/ccnd.sock --replay record.txt &
+ *   ... ccnx-replay.js -s /tmp/ccnd.sock record.txt
+ *
+ * For each load the recorded and replayed load time and bytes are printed,
+ * so that changes to scheduling, caching or windowing can be compared on
+ * the same workload.
+ */
+
+const Cc = Components.classes;
+const Ci = Components.interfaces;
+
+const ios = Cc["@mozilla.org/network/io-service;1"]
+              .getService(Ci.nsIIOService);
+const thread = Cc["@mozilla.org/thread-manager;1"]
+                 .getService(Ci.nsIThreadManager).currentThread;
+
+function readLines(path) {
+  let file = Cc["@mozilla.org/file/local;1"].createInstance(Ci.nsILocalFile);
+  file.initWithPath(path);
+  let fstream = Cc["@mozilla.org/network/file-input-stream;1"]
+                  .createInstance(Ci.nsIFileInputStream);
+  fstream.init(file, -1, 0, 0);
+  fstream.QueryInterface(Ci.nsILineInputStream);
+  let lines = [], line = {}, more;
+  do {
+    more = fstream.readLine(line);
+    if (line.value)
+      lines.push(line.value);
+  } while (more);
+  fstream.close();
+  return lines;
+}
+
+// the streams of the record in the order they were opened, each with its
+// name, open time and recorded duration and size. times are in ms.
+function parseRecord(lines) {
+  let open = {}, streams = [];
+  lines.forEach(function(line) {
+    // the session header
+    if (line[0] == "#")
+      return;
+    let f = line.split(" ");
+    let time = parseInt(f[1]) / 1000, id = f[2];
+    let stream = open[id];
+    switch (f[0]) {
+      case "open":
+        open[id] = { name: f.slice(4).join(" "), start: time, end: time,
+                     bytes: 0, timeouts: 0 };
+        streams.push(open[id]);
+        break;
+      case "data":
+        if (stream) {
+          stream.bytes += parseInt(f[3]);
+          stream.end = time;
+        }
+        break;
+      case "timeout":
+        if (stream)
+          ++stream.timeouts;
+        break;
+      case "close":
+        if (stream) {
+          stream.status = parseInt(f[3]);
+          delete open[id];
+        }
+        break;
+    }
+  });
+  return streams;
+}
+
+function replay(streams) {
+  let pending = streams.length;
+  let first = streams[0].start;
+  let timers = [];
+  streams.forEach(function(stream) {
+    let timer = Cc["@mozilla.org/timer;1"].createInstance(Ci.nsITimer);
+    timers.push(timer);
+    timer.initWithCallback({ notify: function() {
+      let channel = ios.newChannel(stream.name, null, null);
+      let opened = Date.now();
+      stream.replayBytes = 0;
+      channel.asyncOpen({
+        onStartRequest: function(request, context) {},
+        onDataAvailable: function(request, context, input, offset, count) {
+          let sstream = Cc["@mozilla.org/scriptableinputstream;1"]
+                          .createInstance(Ci.nsIScriptableInputStream);
+          sstream.init(input);
+          sstream.read(count);
+          stream.replayBytes += count;
+        },
+        onStopRequest: function(request, context, status) {
+          stream.replayMs = Date.now() - opened;
+          stream.replayStatus = status;
+          --pending;
+        }
+      }, null);
+    }}, stream.start - first, Ci.nsITimer.TYPE_ONE_SHOT);
+  });
+  while (pending)
+    thread.processNextEvent(true);
+}
+
+function run(args) {
+  let output = null, socket = null, record = null;
+  for (let i = 0; i < args.length; ++i) {
+    if (args[i] == "-o")
+      output = args[++i];
+    else if (args[i] == "-s")
+      socket = args[++i];
+    else
+      record = args[i];
+  }
+  if (!record) {
+    dump("usage: ccnx-replay.js [-o results.json] [-s socket] record.txt\n");
+    return 2;
+  }
+  // before the first load, which creates the handler that reads it
+  if (socket) {
+    Cc["@mozilla.org/preferences-service;1"].getService(Ci.nsIPrefBranch)
+      .setCharPref("network.ccnx.ccnd_socket", socket);
+  }
+
+  let streams = parseRecord(readLines(record));
+  if (!streams.length) {
+    dump("nothing recorded in " + record + "\n");
+    return 1;
+  }
+  replay(streams);
+
+  let recordedTotal = 0, replayedTotal = 0, failed = 0;
+  streams.forEach(function(s) {
+    s.recordedMs = s.end - s.start;
+    recordedTotal += s.recordedMs;
+    replayedTotal += s.replayMs;
+    if (!Components.isSuccessCode(s.replayStatus))
+      ++failed;
+    dump(s.name + ": recorded " + s.recordedMs.toFixed(1) + " ms " +
+         s.bytes + " bytes, replayed " + s.replayMs + " ms " +
+         s.replayBytes + " bytes\n");
+  });
+  dump(streams.length + " loads, " + failed + " failed; total recorded " +
+       recordedTotal.toFixed(1) + " ms, replayed " + replayedTotal + " ms\n");
+
+  if (output) {
+    let file = Cc["@mozilla.org/file/local;1"]
+                 .createInstance(Ci.nsILocalFile);
+    file.initWithPath(output);
+    let ostream = Cc["@mozilla.org/network/file-output-stream;1"]
+                    .createInstance(Ci.nsIFileOutputStream);
+    // write, create, truncate
+    ostream.init(file, 0x02 | 0x08 | 0x20, 0644, 0);
+    let json = JSON.stringify({ record: record, streams: streams }, null, 2);
+    ostream.write(json, json.length);
+    ostream.close();
+  }
+  return failed ? 1 : 0;
+}
+
+quit(run(arguments));
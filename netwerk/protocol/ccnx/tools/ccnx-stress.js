@@ -0,0 +1,206 @@
+/* -*- Mode: js; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is mozilla.org code.
+ *
+ * The Initial Developer of the Original Code is
+ * Netscape Communications Corporation.
+ * Portions created by the Initial Developer are Copyright (C) 2012
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Jiwen Cai <jwcai@cs.ucla.edu>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Stress test of many simultaneous ccnx: loads, run with xpcshell from the
+ * object directory against a local ccnd:
+ *
+ *   XPCOM_MEM_LEAK_LOG=leaks.log dist/bin/run-mozilla.sh dist/bin/xpcshell \
+ *       ccnx-stress.js [-n loads] [-w seconds] [-s socket] \
+ *       ccnx:/stress/obj%d
+ *
+ * -s sets network.ccnx.ccnd_socket, e.g. to the socket of
+ * tools/fake-ccnd.py serving files fixtures/stress/obj0 ... as canned content:
+ *
+ *   fake-ccnd.py --socket /tmp/ccnd.sock --fixtures fixtures --loss 0.01 &
+ *   ... ccnx-stress.js -n 2000 -s /tmp/ccnd.sock ccnx:/stress/obj%d
+ *
+ * Opens |loads| channels (up to 10000) at once; a %d in the name is replaced
+ * by the index of the load, so they can fetch one or many objects. Reports
+ * the completion times, peak threads, open file descriptors and resident
+ * memory, then waits |w| seconds (default 40, past the idle timeout of the
+ * transport threads) and checks that the process is back to the threads it
+ * started with. The leak log written at exit covers clean shutdown. Thread,
+ * descriptor and memory counts come from /proc, so this is Linux only.
+ */
+
+const Cc = Components.classes;
+const Ci = Components.interfaces;
+
+const ios = Cc["@mozilla.org/network/io-service;1"]
+              .getService(Ci.nsIIOService);
+const thread = Cc["@mozilla.org/thread-manager;1"]
+                 .getService(Ci.nsIThreadManager).currentThread;
+
+function readProcFile(name) {
+  let file = Cc["@mozilla.org/file/local;1"].createInstance(Ci.nsILocalFile);
+  file.initWithPath(name);
+  let fstream = Cc["@mozilla.org/network/file-input-stream;1"]
+                  .createInstance(Ci.nsIFileInputStream);
+  fstream.init(file, -1, 0, 0);
+  // /proc files have no size, so read until the converter runs dry
+  let cstream = Cc["@mozilla.org/intl/converter-input-stream;1"]
+                  .createInstance(Ci.nsIConverterInputStream);
+  cstream.init(fstream, "UTF-8", 4096, 0);
+  let data = "", str = {};
+  while (cstream.readString(4096, str))
+    data += str.value;
+  cstream.close();
+  return data;
+}
+
+function statusField(name) {
+  let m = readProcFile("/proc/self/status")
+            .match(new RegExp("^" + name + ":\\s*(\\d+)", "m"));
+  return m ? parseInt(m[1]) : 0;
+}
+
+function fdCount() {
+  let dir = Cc["@mozilla.org/file/local;1"].createInstance(Ci.nsILocalFile);
+  dir.initWithPath("/proc/self/fd");
+  let count = 0;
+  let entries = dir.directoryEntries;
+  while (entries.hasMoreElements()) {
+    entries.getNext();
+    ++count;
+  }
+  return count;
+}
+
+function sample(peak) {
+  peak.threads = Math.max(peak.threads, statusField("Threads"));
+  peak.fds = Math.max(peak.fds, fdCount());
+  peak.residentKB = Math.max(peak.residentKB, statusField("VmRSS"));
+}
+
+function percentile(sorted, p) {
+  return sorted.length ? sorted[Math.min(sorted.length - 1,
+                                         Math.floor(sorted.length * p))]
+                       : null;
+}
+
+function run(args) {
+  let loads = 1000, wait = 40, socket = null, name = null;
+  for (let i = 0; i < args.length; ++i) {
+    if (args[i] == "-n")
+      loads = Math.min(parseInt(args[++i]), 10000);
+    else if (args[i] == "-w")
+      wait = parseInt(args[++i]);
+    else if (args[i] == "-s")
+      socket = args[++i];
+    else
+      name = args[i];
+  }
+  if (!name) {
+    dump("usage: ccnx-stress.js [-n loads] [-w seconds] [-s socket] " +
+         "ccnx:/name%d\n");
+    return 2;
+  }
+  // the handler reads the pref when it is created
+  if (socket) {
+    Cc["@mozilla.org/preferences-service;1"].getService(Ci.nsIPrefBranch)
+      .setCharPref("network.ccnx.ccnd_socket", socket);
+  }
+  let handler = ios.getProtocolHandler("ccnx")
+                   .QueryInterface(Ci.nsICCNxProtocolHandler);
+
+  let baseThreads = statusField("Threads");
+  let peak = { threads: 0, fds: 0, residentKB: 0 };
+  let times = [], failed = 0, pending = loads;
+  let start = Date.now();
+
+  for (let i = 0; i < loads; ++i) {
+    let channel = ios.newChannel(name.replace("%d", i), null, null);
+    let opened = Date.now();
+    channel.asyncOpen({
+      onStartRequest: function(request, context) {},
+      onDataAvailable: function(request, context, stream, offset, count) {
+        // throw the data away
+        let sstream = Cc["@mozilla.org/scriptableinputstream;1"]
+                        .createInstance(Ci.nsIScriptableInputStream);
+        sstream.init(stream);
+        sstream.read(count);
+      },
+      onStopRequest: function(request, context, status) {
+        if (Components.isSuccessCode(status))
+          times.push(Date.now() - opened);
+        else
+          ++failed;
+        --pending;
+      }
+    }, null);
+  }
+
+  let lastSample = 0;
+  while (pending) {
+    thread.processNextEvent(true);
+    if (Date.now() - lastSample > 100) {
+      sample(peak);
+      lastSample = Date.now();
+    }
+  }
+  let total = Date.now() - start;
+
+  times.sort(function(a, b) { return a - b; });
+  dump(loads + " loads in " + total + " ms, " + failed + " failed\n" +
+       "completion ms: median " + percentile(times, 0.5) +
+       ", 90% " + percentile(times, 0.9) + ", max " + percentile(times, 1) +
+       "\n" + "peak: " + peak.threads + " threads (" + baseThreads +
+       " before), " + peak.fds + " fds, " + peak.residentKB +
+       " KB resident\n" + "streams still open: " + handler.activeStreams +
+       "\n");
+
+  // idle transport threads go away after their timeout
+  let timer = Cc["@mozilla.org/timer;1"].createInstance(Ci.nsITimer);
+  let waited = false;
+  timer.initWithCallback({ notify: function() { waited = true; } },
+                         wait * 1000, Ci.nsITimer.TYPE_ONE_SHOT);
+  while (!waited)
+    thread.processNextEvent(true);
+
+  let leftThreads = statusField("Threads");
+  dump("threads after " + wait + " s idle: " + leftThreads + "\n");
+  // the transport service keeps at most one idle thread
+  if (leftThreads > baseThreads + 1 || handler.activeStreams) {
+    dump("FAIL: transport threads or streams left behind\n");
+    return 1;
+  }
+  return failed ? 1 : 0;
+}
+
+quit(run(arguments));
@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+# ***** BEGIN LICENSE BLOCK *****
+# Version: MPL 1.1/GPL 2.0/LGPL 2.1
+#
+# The contents of this file are subject to the Mozilla Public License Version
+# 1.1 (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+# http://www.mozilla.org/MPL/
+#
+# Software distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+# for the specific language governing rights and limitations under the
+# License.
+#
+# The Original Code is mozilla.org code.
+#
+# The Initial Developer of the Original Code is
+# Netscape Communications Corporation.
+# Portions created by the Initial Developer are Copyright (C) 2012
+# the Initial Developer. All Rights Reserved.
+#
+# Contributor(s):
+#   Jiwen Cai <jwcai@cs.ucla.edu>
+#
+# Alternatively, the contents of this file may be used under the terms of
+# either the GNU General Public License Version 2 or later (the "GPL"), or
+# the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+# in which case the provisions of the GPL or the LGPL are applicable instead
+# of those above. If you wish to allow use of your version of this file only
+# under the terms of either the GPL or the LGPL, and not to allow others to
+# use your version of this file under the terms of the MPL, indicate your
+# decision by deleting the provisions above and replace them with the notice
+# and other provisions required by the GPL or the LGPL. If you do not delete
+# the provisions above, a recipient may use your version of this file under
+# the terms of any one of the MPL, the GPL or the LGPL.
+#
+# ***** END LICENSE BLOCK *****
+
+"""Decode a CCNx event trace written by nsICCNxProtocolHandler.dumpTrace.
+
+Usage: decode-ccnx-trace.py [--raw] trace.bin
+
+Prints one line per event: milliseconds since the first event, thread,
+object, event and argument. With --raw the absolute PR_Now() time in
+microseconds is printed instead. The record layout is nsCCNxTraceEvent in
+nsCCNxTrace.h.
+"""
+
+import struct
+import sys
+
+VERSION = 1
+HEADER = '8sIIIIq'
+RECORD = 'qQQIHH'
+
+EVENTS = {
+    1: 'open',
+    4: 'timeout',
+    5: 'read',
+    6: 'callback',
+    7: 'close',
+}
+
+
+def byte_order(data):
+    for order in ('<', '>'):
+        fields = struct.unpack_from(order + HEADER, data)
+        if fields[4] == 0x01020304:
+            return order, fields
+    raise ValueError('not a ccnx trace, or a corrupt one')
+
+
+def decode(data, raw=False, out=sys.stdout):
+    order, header = byte_order(data)
+    magic, version, record_size, count = header[0:4]
+    if not magic.startswith(b'CCNXTRC'):
+        raise ValueError('not a ccnx trace')
+    if version != VERSION:
+        raise ValueError('unsupported trace version %d' % version)
+    if record_size != struct.calcsize(order + RECORD):
+        raise ValueError('unexpected record size %d' % record_size)
+
+    offset = struct.calcsize(order + HEADER)
+    start = None
+    for i in range(count):
+        time, obj, arg, seq, kind, thread = \
+            struct.unpack_from(order + RECORD, data, offset + i * record_size)
+        if start is None:
+            start = time
+        name = EVENTS.get(kind, 'event%d' % kind)
+        if name == 'close':
+            arg = '0x%08x' % arg
+        elif name == 'callback':
+            arg = 'async' if arg else 'sync'
+        if raw:
+            stamp = '%d' % time
+        else:
+            stamp = '%12.3f' % ((time - start) / 1000.0)
+        out.write('%s %10u t%04x 0x%012x %-8s %s\n' %
+                  (stamp, seq, thread, obj, name, arg))
+
+
+def main(argv):
+    raw = '--raw' in argv
+    args = [a for a in argv if a != '--raw']
+    if len(args) != 1:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(args[0], 'rb') as f:
+        data = f.read()
+    try:
+        decode(data, raw)
+    except ValueError as e:
+        sys.stderr.write('%s: %s\n' % (args[0], e))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
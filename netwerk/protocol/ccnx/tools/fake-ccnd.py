@@ -0,0 +1,911 @@
+#!/usr/bin/env python
+# ***** BEGIN LICENSE BLOCK *****
+# Version: MPL 1.1/GPL 2.0/LGPL 2.1
+#
+# The contents of this file are subject to the Mozilla Public License Version
+# 1.1 (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+# http://www.mozilla.org/MPL/
+#
+# Software distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+# for the specific language governing rights and limitations under the
+# License.
+#
+# The Original Code is mozilla.org code.
+#
+# The Initial Developer of the Original Code is
+# Netscape Communications Corporation.
+# Portions created by the Initial Developer are Copyright (C) 2012
+# the Initial Developer. All Rights Reserved.
+#
+# Contributor(s):
+#   Jiwen Cai <jwcai@cs.ucla.edu>
+#
+# Alternatively, the contents of this file may be used under the terms of
+# either the GNU General Public License Version 2 or later (the "GPL"), or
+# the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+# in which case the provisions of the GPL or the LGPL are applicable instead
+# of those above. If you wish to allow use of your version of this file only
+# under the terms of either the GPL or the LGPL, and not to allow others to
+# use your version of this file under the terms of the MPL, indicate your
+# decision by deleting the provisions above and replace them with the notice
+# and other provisions required by the GPL or the LGPL. If you do not delete
+# the provisions above, a recipient may use your version of this file under
+# the terms of any one of the MPL, the GPL or the LGPL.
+#
+# ***** END LICENSE BLOCK *****
+
+"""A stand-in for ccnd that serves canned content, for testing the ccnx:
+protocol without a CCNx network.
+
+Usage: fake-ccnd.py --socket PATH [options] [--fixtures DIR] [--replay FILE]
+
+Listens on the unix socket PATH, which the browser uses once the pref
+network.ccnx.ccnd_socket points at it, and answers Interests the way ccnd
+answers them from its content store:
+
+  --fixtures DIR    every file below DIR is published under its relative
+                    path, e.g. DIR/parc.com/index.html as
+                    ccnx:/parc.com/index.html, with a version component and
+                    segments of --segment-size bytes, signed like
+                    ccnputfile does
+  --prefix URI      name prepended to the fixture names
+  --replay FILE     serves the names of a network.ccnx.record_file record
+                    with as many bytes as were recorded, each segment held
+                    back until the time its last byte was read in the
+                    recording
+  --delay MS        time every answer takes
+  --jitter MS       random extra time of an answer, up to MS; answers
+                    overtake each other when this is larger than the gap
+                    between the Interests
+  --loss FRACTION   fraction of the Interests for a given segment that go
+                    unanswered. ccn_fetch expresses those again after
+                    their lifetime, but libccn gives up on a lost Interest
+                    resolving the version, so those are always answered
+  --seed N          seed of the signing key, the loss and the jitter.
+                    Which answers are lost and how late they come is
+                    drawn per segment and per Interest for it on a face,
+                    not in the order Interests come in from all faces
+  --clock SECONDS   time used for the timestamps and versions of the
+                    content, so that the same fixtures give the same bytes
+  --virtual-time    time the answers on a clock that stands still while
+                    the clients talk and jumps to the next answer once
+                    they have been quiet for 50 ms. --delay, --jitter and
+                    --replay then only decide the order of the answers,
+                    which is the same on every run as long as the clients
+                    send the same Interests and answer within 50 ms;
+                    Interest lifetimes still run on the clients' clock
+
+Prints one line with the socket path to stdout once it accepts connections,
+and with -v one line per Interest to stderr. Only what ccn_fetch needs is
+implemented: no forwarding, no prefix registration, and ContentObjects sent
+to it are dropped. The ccnb encoding and the signing are usable on their own,
+see tests/test_fake_ccnd.py.
+"""
+
+import errno
+import hashlib
+import heapq
+import os
+import random
+import select
+import signal
+import socket
+import sys
+import time
+
+# ccnb token types and the dictionary tags we need, from ccn/coding.h
+CCN_EXT, CCN_TAG, CCN_DTAG, CCN_ATTR, CCN_DATTR, CCN_BLOB, CCN_UDATA = \
+    range(7)
+
+DTAG_Any = 13
+DTAG_Name = 14
+DTAG_Component = 15
+DTAG_Content = 19
+DTAG_SignedInfo = 20
+DTAG_Interest = 26
+DTAG_Key = 27
+DTAG_KeyLocator = 28
+DTAG_Signature = 37
+DTAG_Timestamp = 39
+DTAG_Type = 40
+DTAG_Nonce = 41
+DTAG_Scope = 42
+DTAG_Exclude = 43
+DTAG_Bloom = 44
+DTAG_AnswerOriginKind = 47
+DTAG_InterestLifetime = 48
+DTAG_SignatureBits = 54
+DTAG_DigestAlgorithm = 55
+DTAG_FreshnessSeconds = 58
+DTAG_FinalBlockID = 59
+DTAG_PublisherPublicKeyDigest = 60
+DTAG_ContentObject = 64
+DTAG_MinSuffixComponents = 83
+DTAG_MaxSuffixComponents = 84
+DTAG_ChildSelector = 85
+
+VERSION_MARKER = 0xFD
+SEGMENT_MARKER = 0x00
+
+
+#
+# ccnb encoding
+#
+
+def encode_tt(value, tt):
+    """The header of a token, as ccn_charbuf_append_tt writes it."""
+    out = bytearray([0x80 | ((value & 0xF) << 3) | tt])
+    value >>= 4
+    while value:
+        out.insert(0, value & 0x7F)
+        value >>= 7
+    return bytes(out)
+
+
+def element(dtag, *children):
+    return encode_tt(dtag, CCN_DTAG) + b''.join(children) + b'\x00'
+
+
+def blob_element(dtag, data):
+    """Like ccnb_append_tagged_blob, which leaves out an empty blob."""
+    data = bytes(data)
+    if not data:
+        return element(dtag)
+    return element(dtag, encode_tt(len(data), CCN_BLOB) + data)
+
+
+def number_element(dtag, number):
+    """Like ccnb_tagged_putf(c, dtag, "%d", number)."""
+    text = str(number).encode('ascii')
+    return element(dtag, encode_tt(len(text), CCN_UDATA) + text)
+
+
+def encode_name(components):
+    return element(DTAG_Name,
+                   *[blob_element(DTAG_Component, c) for c in components])
+
+
+class Element(object):
+    """A decoded ccnb element: its dictionary tag and its items, which are
+    Elements or, for blobs and udata, bytes."""
+
+    def __init__(self, dtag):
+        self.dtag = dtag
+        self.items = []
+
+    def children(self, dtag):
+        return [i for i in self.items
+                if isinstance(i, Element) and i.dtag == dtag]
+
+    def child(self, dtag):
+        found = self.children(dtag)
+        return found[0] if found else None
+
+    def data(self):
+        return b''.join(i for i in self.items if isinstance(i, bytes))
+
+    def number(self, dtag, default=None):
+        found = self.child(dtag)
+        return int(found.data()) if found is not None else default
+
+
+class Incomplete(Exception):
+    pass
+
+
+def read_tt(buf, pos):
+    value = 0
+    while True:
+        if pos >= len(buf):
+            raise Incomplete()
+        byte = buf[pos]
+        pos += 1
+        if byte & 0x80:
+            return (value << 4) | ((byte >> 3) & 0xF), byte & 0x7, pos
+        value = (value << 7) | byte
+
+
+def decode(buf, pos=0):
+    """Decodes the element starting at |pos| of the bytearray |buf|.
+    Returns it and the position after it, or raises Incomplete."""
+    if pos < len(buf) and buf[pos] == 0:
+        raise ValueError('unexpected closer')
+    value, tt, pos = read_tt(buf, pos)
+    if tt == CCN_TAG:
+        pos += value + 1
+        value = -1
+    elif tt != CCN_DTAG:
+        raise ValueError('not an element: token type %d' % tt)
+    elem = Element(value)
+    while True:
+        if pos >= len(buf):
+            raise Incomplete()
+        if buf[pos] == 0:
+            return elem, pos + 1
+        value, tt, next_pos = read_tt(buf, pos)
+        if tt in (CCN_BLOB, CCN_UDATA):
+            if next_pos + value > len(buf):
+                raise Incomplete()
+            elem.items.append(bytes(buf[next_pos:next_pos + value]))
+            pos = next_pos + value
+        elif tt in (CCN_ATTR, CCN_DATTR):
+            # attributes carry an udata value, none of ours has any
+            if tt == CCN_ATTR:
+                next_pos += value + 1
+            value, tt, pos = read_tt(buf, next_pos)
+            pos += value
+        else:
+            child, pos = decode(buf, pos)
+            elem.items.append(child)
+
+
+def name_components(elem):
+    name = elem.child(DTAG_Name)
+    return [c.data() for c in name.children(DTAG_Component)] if name else []
+
+
+#
+# names
+#
+
+URI_SAFE = (b'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ'
+            b'0123456789-._~')
+
+
+def name_from_uri(uri):
+    """Components of a ccnx: URI, percent escapes decoded."""
+    if uri.startswith('ccnx:'):
+        uri = uri[5:]
+    components = []
+    for part in uri.split('/'):
+        if not part:
+            continue
+        out = bytearray()
+        i = 0
+        while i < len(part):
+            if part[i] == '%' and i + 3 <= len(part):
+                out.append(int(part[i + 1:i + 3], 16))
+                i += 3
+            else:
+                out.extend(part[i].encode('utf-8'))
+                i += 1
+        components.append(bytes(out))
+    return components
+
+
+def uri_from_name(components):
+    parts = []
+    for c in components:
+        parts.append(''.join(chr(b) if b in bytearray(URI_SAFE)
+                             else '%%%02X' % b for b in bytearray(c)))
+    return 'ccnx:/' + '/'.join(parts)
+
+
+def numeric_component(marker, number):
+    """Like ccn_name_append_numeric: the marker, then the number big endian
+    without leading zero bytes."""
+    out = bytearray()
+    while number:
+        out.insert(0, number & 0xFF)
+        number >>= 8
+    return bytes(bytearray([marker]) + out)
+
+
+def segment_number(component):
+    component = bytearray(component)
+    if not component or component[0] != SEGMENT_MARKER:
+        return None
+    number = 0
+    for b in component[1:]:
+        number = (number << 8) | b
+    return number
+
+
+def timestamp_bytes(seconds):
+    """A ccnb Timestamp: seconds in binary fixed point with 12 fractional
+    bits, big endian, no leading zero bytes."""
+    units = int(seconds * 4096)
+    out = bytearray()
+    while units:
+        out.insert(0, units & 0xFF)
+        units >>= 8
+    return bytes(out)
+
+
+def canonical_key(component):
+    """CCNx orders components by length first, then by their bytes."""
+    return (len(component), bytes(component))
+
+
+#
+# signing
+#
+
+def _is_probable_prime(n, rng, rounds=32):
+    if n < 2:
+        return False
+    for p in (2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37):
+        if n % p == 0:
+            return n == p
+    d, s = n - 1, 0
+    while d % 2 == 0:
+        d //= 2
+        s += 1
+    for _ in range(rounds):
+        x = pow(rng.randrange(2, n - 1), d, n)
+        if x in (1, n - 1):
+            continue
+        for _ in range(s - 1):
+            x = pow(x, 2, n)
+            if x == n - 1:
+                break
+        else:
+            return False
+    return True
+
+
+def _prime(bits, rng):
+    while True:
+        n = rng.getrandbits(bits) | (3 << (bits - 2)) | 1
+        if _is_probable_prime(n, rng):
+            return n
+
+
+def _inverse(a, m):
+    x0, x1, r0, r1 = 1, 0, a, m
+    while r1:
+        q = r0 // r1
+        x0, x1, r0, r1 = x1, x0 - q * x1, r1, r0 - q * r1
+    return x0 % m
+
+
+def _to_int(data):
+    n = 0
+    for b in bytearray(data):
+        n = (n << 8) | b
+    return n
+
+
+def _der_length(n):
+    if n < 0x80:
+        return bytearray([n])
+    out = bytearray()
+    while n:
+        out.insert(0, n & 0xFF)
+        n >>= 8
+    return bytearray([0x80 | len(out)]) + out
+
+
+def _der(tag, content):
+    return bytes(bytearray([tag]) + _der_length(len(content)) + content)
+
+
+def _der_integer(n):
+    out = bytearray()
+    while n:
+        out.insert(0, n & 0xFF)
+        n >>= 8
+    if not out or out[0] & 0x80:
+        out.insert(0, 0)
+    return _der(0x02, bytes(out))
+
+
+# DER of the AlgorithmIdentifier of rsaEncryption, and the DigestInfo
+# prefix of a SHA-256 hash, for PKCS #1 v1.5 signatures
+RSA_ALGORITHM = bytes(bytearray.fromhex('300d06092a864886f70d0101010500'))
+SHA256_DIGEST_INFO = bytes(bytearray.fromhex(
+    '3031300d060960864801650304020105000420'))
+
+
+class Key(object):
+    """An RSA key pair made from a seed, so that a fixture is signed the
+    same way every time."""
+
+    def __init__(self, seed, bits=1024):
+        rng = random.Random(seed)
+        e = 65537
+        while True:
+            p = _prime(bits // 2, rng)
+            q = _prime(bits // 2, rng)
+            phi = (p - 1) * (q - 1)
+            if p != q and phi % e:
+                break
+        self.n, self.e = p * q, e
+        self.d = _inverse(e, phi)
+        self.p, self.q = p, q
+        self.dp, self.dq = self.d % (p - 1), self.d % (q - 1)
+        self.qinv = _inverse(q, p)
+        self.size = (self.n.bit_length() + 7) // 8
+        public = _der(0x30, _der_integer(self.n) + _der_integer(self.e))
+        # SubjectPublicKeyInfo, which ccnd publishes as the Key
+        self.der = _der(0x30, RSA_ALGORITHM + _der(0x03, b'\x00' + public))
+        self.digest = hashlib.sha256(self.der).digest()
+
+    def _encoded(self, data):
+        digest = SHA256_DIGEST_INFO + hashlib.sha256(data).digest()
+        padding = b'\xff' * (self.size - len(digest) - 3)
+        return _to_int(b'\x00\x01' + padding + b'\x00' + digest)
+
+    def sign(self, data):
+        m = self._encoded(data)
+        # CRT, about four times faster than pow(m, d, n)
+        m1 = pow(m, self.dp, self.p)
+        m2 = pow(m, self.dq, self.q)
+        s = m2 + self.q * ((self.qinv * (m1 - m2)) % self.p)
+        out = bytearray()
+        for _ in range(self.size):
+            out.insert(0, s & 0xFF)
+            s >>= 8
+        return bytes(out)
+
+    def verify(self, data, signature):
+        return pow(_to_int(signature), self.e, self.n) == self._encoded(data)
+
+
+def content_object(key, components, content, timestamp, final_segment,
+                   freshness=None):
+    """Encodes and signs a ContentObject of type DATA, with the public key
+    in its KeyLocator so that libccn can verify it without asking for the
+    key. The signature covers Name, SignedInfo and Content."""
+    name = encode_name(components)
+    info = [blob_element(DTAG_PublisherPublicKeyDigest, key.digest),
+            blob_element(DTAG_Timestamp, timestamp_bytes(timestamp))]
+    if freshness is not None:
+        info.append(number_element(DTAG_FreshnessSeconds, freshness))
+    info.append(blob_element(DTAG_FinalBlockID, final_segment))
+    info.append(element(DTAG_KeyLocator, blob_element(DTAG_Key, key.der)))
+    signed_info = element(DTAG_SignedInfo, *info)
+    body = blob_element(DTAG_Content, content)
+    signature = element(DTAG_Signature, blob_element(
+        DTAG_SignatureBits, key.sign(name + signed_info + body)))
+    return element(DTAG_ContentObject, signature, name, signed_info, body)
+
+
+def signed_portion(data):
+    """The bytes of an encoded ContentObject covered by its signature."""
+    buf = bytearray(data)
+    value, tt, pos = read_tt(buf, 0)
+    _, start = decode(buf, pos)         # Signature
+    _, end = decode(buf, start)         # Name
+    _, end = decode(buf, end)           # SignedInfo
+    _, end = decode(buf, end)           # Content
+    return bytes(buf[start:end])
+
+
+#
+# content
+#
+
+class Publication(object):
+    """The segments of one version of a name, encoded on first use."""
+
+    def __init__(self, key, components, data, segment_size, timestamp,
+                 schedule=None):
+        self.key = key
+        self.components = list(components)
+        self.data = data
+        self.segment_size = segment_size
+        self.timestamp = timestamp
+        self.version = numeric_component(VERSION_MARKER,
+                                         int(timestamp * 4096))
+        self.count = max(1, (len(data) + segment_size - 1) // segment_size)
+        self.final = numeric_component(SEGMENT_MARKER, self.count - 1)
+        # seconds from the first Interest after which each segment may be
+        # answered, see --replay
+        self.schedule = schedule
+        self._encoded = {}
+
+    def segment_component(self, index):
+        return numeric_component(SEGMENT_MARKER, index)
+
+    def encoded(self, index):
+        if index not in self._encoded:
+            start = index * self.segment_size
+            self._encoded[index] = content_object(
+                self.key,
+                self.components + [self.version,
+                                   self.segment_component(index)],
+                self.data[start:start + self.segment_size],
+                self.timestamp, self.final)
+        return self._encoded[index]
+
+    def digest(self, index):
+        return hashlib.sha256(self.encoded(index)).digest()
+
+    def candidates(self, prefix):
+        """(next component, segment index, suffix components) for each
+        segment whose full name, with the implicit digest, starts with
+        |prefix|."""
+        base = self.components
+        n = len(prefix)
+        if n <= len(base):
+            if prefix != base[:n]:
+                return []
+            nxt = base[n] if n < len(base) else self.version
+            suffix = len(base) + 3 - n
+            # the same next component for all segments, the first stands
+            # for them
+            return [(nxt, 0, suffix)]
+        if prefix[len(base)] != self.version or prefix[:len(base)] != base:
+            return []
+        if n == len(base) + 1:
+            return [(self.segment_component(i), i, 2)
+                    for i in range(self.count)]
+        index = segment_number(prefix[len(base) + 1])
+        if index is None or index >= self.count or \
+                prefix[len(base) + 1] != self.segment_component(index):
+            return []
+        if n == len(base) + 2:
+            return [(self.digest(index), index, 1)]
+        if n == len(base) + 3 and prefix[-1] == self.digest(index):
+            return [(None, index, 0)]
+        return []
+
+
+def excluded(exclude, component):
+    """Whether |component| falls under the Exclude element: listed, or in
+    a range an Any stands for. Bloom filters are ignored."""
+    if exclude is None or component is None:
+        return False
+    key = canonical_key(component)
+    items = [i for i in exclude.items
+             if isinstance(i, Element) and i.dtag in (DTAG_Any,
+                                                      DTAG_Component)]
+    for i, item in enumerate(items):
+        if item.dtag == DTAG_Component:
+            if canonical_key(item.data()) == key:
+                return True
+            continue
+        # an Any covers everything between its neighbours
+        low = items[i - 1] if i > 0 else None
+        high = items[i + 1] if i + 1 < len(items) else None
+        if low is not None and canonical_key(low.data()) >= key:
+            continue
+        if high is not None and canonical_key(high.data()) <= key:
+            continue
+        return True
+    return False
+
+
+def match(publications, interest):
+    """The (publication, segment) ccnd would answer |interest| with."""
+    prefix = name_components(interest)
+    min_suffix = interest.number(DTAG_MinSuffixComponents, 0)
+    max_suffix = interest.number(DTAG_MaxSuffixComponents, None)
+    rightmost = interest.number(DTAG_ChildSelector, 0) & 1
+    exclude = interest.child(DTAG_Exclude)
+    publisher = interest.child(DTAG_PublisherPublicKeyDigest)
+    best = None
+    for pub in publications:
+        if publisher is not None and publisher.data() != pub.key.digest:
+            continue
+        for nxt, index, suffix in pub.candidates(prefix):
+            if suffix < min_suffix or \
+                    (max_suffix is not None and suffix > max_suffix):
+                continue
+            if excluded(exclude, nxt):
+                continue
+            order = canonical_key(nxt) if nxt is not None else (0, b'')
+            if best is None or (order > best[0] if rightmost
+                                else order < best[0]):
+                best = (order, pub, index)
+    return best[1:] if best else None
+
+
+def load_fixtures(root, prefix, key, segment_size, clock):
+    publications = []
+    for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
+        for filename in sorted(filenames):
+            path = os.path.join(dirpath, filename)
+            relative = os.path.relpath(path, root).split(os.sep)
+            with open(path, 'rb') as f:
+                data = f.read()
+            components = prefix + [c.encode('utf-8') for c in relative]
+            publications.append(Publication(key, components, data,
+                                            segment_size, clock))
+    return publications
+
+
+def load_record(path, key, segment_size, clock):
+    """Publications for the streams of a recorder file: the recorded
+    number of bytes, and the time after the open each segment was read
+    completely. A data line is one read of the browser, whatever the
+    segments were."""
+    streams, open_streams = [], {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith('#'):
+                continue
+            kind, usec, stream = fields[0], int(fields[1]), fields[2]
+            if kind == 'open':
+                entry = {'name': ' '.join(fields[4:]), 'start': usec,
+                         'reads': []}
+                open_streams[stream] = entry
+                streams.append(entry)
+            elif kind == 'data' and stream in open_streams:
+                entry = open_streams[stream]
+                entry['reads'].append(((usec - entry['start']) / 1e6,
+                                       int(fields[3])))
+            elif kind == 'close':
+                open_streams.pop(stream, None)
+    publications, seen = [], set()
+    for entry in streams:
+        if entry['name'] in seen:
+            continue
+        seen.add(entry['name'])
+        size = sum(r[1] for r in entry['reads'])
+        components = name_from_uri(entry['name'])
+        # the same bytes for the same name and size
+        rng = random.Random(entry['name'] + str(size))
+        data = bytes(bytearray(rng.getrandbits(8) for _ in range(size)))
+        schedule, read, reads = [], 0, iter(entry['reads'])
+        when = 0.0
+        for end in range(segment_size, size + segment_size, segment_size):
+            while read < min(end, size):
+                when, n = next(reads)
+                read += n
+            schedule.append(when)
+        schedule = schedule or [0.0]
+        publications.append(Publication(key, components, data,
+                                        segment_size, clock, schedule))
+    return publications
+
+
+#
+# the server
+#
+
+class WallClock(object):
+    def now(self):
+        return time.time()
+
+    def timeout(self, when):
+        """How long to wait in select for an answer due at |when|."""
+        return max(0, when - self.now())
+
+    def idle(self, when):
+        pass
+
+
+class VirtualClock(object):
+    """See --virtual-time."""
+    IDLE = 0.05
+
+    def __init__(self):
+        self.current = 0.0
+
+    def now(self):
+        return self.current
+
+    def timeout(self, when):
+        return self.IDLE
+
+    def idle(self, when):
+        # nothing came in for IDLE seconds, the next answer is due
+        self.current = max(self.current, when)
+
+
+class Face(object):
+    def __init__(self, sock):
+        self.sock = sock
+        self.inbuf = bytearray()
+        self.outbuf = bytearray()
+        # first Interest time per replayed publication
+        self.started = {}
+        # Interests seen per (publication, segment, names the segment)
+        self.attempts = {}
+
+
+class FakeCCNd(object):
+    def __init__(self, path, publications, delay=0.0, jitter=0.0, loss=0.0,
+                 seed=0, clock=None, verbose=False, out=sys.stderr):
+        self.path = path
+        self.publications = publications
+        self.delay, self.jitter, self.loss = delay, jitter, loss
+        self.seed = seed
+        self.clock = clock or WallClock()
+        self.verbose = verbose
+        self.out = out
+        self.faces = {}
+        self.pending = []
+        self.sequence = 0
+        self.interests = 0
+        self.answered = 0
+        if os.path.exists(path):
+            os.unlink(path)
+        self.listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.listener.bind(path)
+        self.listener.listen(128)
+
+    def close(self):
+        for face in list(self.faces.values()):
+            face.sock.close()
+        self.listener.close()
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+
+    def log(self, message):
+        if self.verbose:
+            self.out.write('fake-ccnd: %s\n' % message)
+
+    def draw(self, face, pub, index, names_segment):
+        """The random source of one answer: the same for the n-th Interest
+        of a face for a segment whatever else the face and the others
+        asked for in between."""
+        key = (id(pub), index, names_segment)
+        attempt = face.attempts.get(key, 0)
+        face.attempts[key] = attempt + 1
+        seed = '%d %s %d %d %d' % (self.seed, uri_from_name(pub.components),
+                                   index, names_segment, attempt)
+        return random.Random(_to_int(hashlib.sha1(
+            seed.encode('ascii')).digest()))
+
+    def on_interest(self, face, interest):
+        self.interests += 1
+        found = match(self.publications, interest)
+        self.log('interest %s -> %s' % (
+            uri_from_name(name_components(interest)),
+            'segment %d of %s' % (found[1], uri_from_name(found[0].components))
+            if found else 'nothing'))
+        if not found:
+            return
+        pub, index = found
+        names_segment = len(name_components(interest)) > \
+            len(pub.components) + 1
+        rng = self.draw(face, pub, index, names_segment)
+        if names_segment and self.loss and rng.random() < self.loss:
+            self.log('  lost')
+            return
+        now = self.clock.now()
+        when = now + self.delay
+        if self.jitter:
+            when += rng.uniform(0, self.jitter)
+        if pub.schedule is not None:
+            start = face.started.setdefault(id(pub), now)
+            offset = pub.schedule[min(index, len(pub.schedule) - 1)]
+            when = max(when, start + offset)
+            if index == pub.count - 1:
+                # the next load of the name starts over
+                del face.started[id(pub)]
+        self.sequence += 1
+        heapq.heappush(self.pending, (when, self.sequence, face,
+                                      pub.encoded(index)))
+
+    def on_readable(self, face):
+        try:
+            data = face.sock.recv(65536)
+        except socket.error as e:
+            if e.errno in (errno.EAGAIN, errno.EINTR):
+                return
+            data = b''
+        if not data:
+            self.drop(face)
+            return
+        face.inbuf.extend(data)
+        while face.inbuf:
+            try:
+                elem, end = decode(face.inbuf)
+            except Incomplete:
+                break
+            except ValueError as e:
+                self.log('bad ccnb from a client: %s' % e)
+                self.drop(face)
+                return
+            del face.inbuf[:end]
+            if elem.dtag == DTAG_Interest:
+                self.on_interest(face, elem)
+
+    def drop(self, face):
+        self.faces.pop(face.sock.fileno(), None)
+        face.sock.close()
+        face.sock = None
+
+    def run(self, until=None):
+        while until is None or not until():
+            now = self.clock.now()
+            while self.pending and self.pending[0][0] <= now:
+                _, _, face, data = heapq.heappop(self.pending)
+                if face.sock is not None:
+                    face.outbuf.extend(data)
+                    self.answered += 1
+            timeout = 0.1
+            if self.pending:
+                timeout = min(timeout, self.clock.timeout(self.pending[0][0]))
+            readers = [self.listener] + [f.sock for f in self.faces.values()]
+            writers = [f.sock for f in self.faces.values() if f.outbuf]
+            try:
+                readable, writable, _ = select.select(readers, writers, [],
+                                                      timeout)
+            except select.error as e:
+                if e.args[0] == errno.EINTR:
+                    continue
+                raise
+            if self.pending and not readable and not writable:
+                self.clock.idle(self.pending[0][0])
+            for sock in readable:
+                if sock is self.listener:
+                    client, _ = self.listener.accept()
+                    client.setblocking(False)
+                    self.faces[client.fileno()] = Face(client)
+                    self.log('new face %d' % client.fileno())
+                else:
+                    face = self.faces.get(sock.fileno())
+                    if face:
+                        self.on_readable(face)
+            for sock in writable:
+                face = self.faces.get(sock.fileno())
+                if not face or face.sock is None:
+                    continue
+                try:
+                    sent = face.sock.send(face.outbuf)
+                    del face.outbuf[:sent]
+                except socket.error as e:
+                    if e.errno not in (errno.EAGAIN, errno.EINTR):
+                        self.drop(face)
+
+
+def main(argv):
+    options = {'socket': None, 'fixtures': None, 'prefix': '',
+               'replay': None, 'segment-size': '4096', 'delay': '0',
+               'jitter': '0', 'loss': '0', 'seed': '0',
+               'clock': '1325376000'}
+    verbose = False
+    clock = None
+    args = list(argv)
+    while args:
+        arg = args.pop(0)
+        if arg == '-v':
+            verbose = True
+        elif arg == '--virtual-time':
+            clock = VirtualClock()
+        elif arg.startswith('--') and arg[2:] in options and args:
+            options[arg[2:]] = args.pop(0)
+        else:
+            sys.stderr.write(__doc__)
+            return 2
+    if not options['socket'] or \
+            not (options['fixtures'] or options['replay']):
+        sys.stderr.write(__doc__)
+        return 2
+
+    key = Key(int(options['seed']))
+    segment_size = int(options['segment-size'])
+    timestamp = float(options['clock'])
+    publications = []
+    if options['fixtures']:
+        publications += load_fixtures(options['fixtures'],
+                                      name_from_uri(options['prefix']),
+                                      key, segment_size, timestamp)
+    if options['replay']:
+        publications += load_record(options['replay'], key, segment_size,
+                                    timestamp)
+
+    server = FakeCCNd(options['socket'], publications,
+                      delay=float(options['delay']) / 1000,
+                      jitter=float(options['jitter']) / 1000,
+                      loss=float(options['loss']),
+                      seed=int(options['seed']), clock=clock,
+                      verbose=verbose)
+    stopping = []
+    signal.signal(signal.SIGTERM, lambda *args: stopping.append(True))
+    signal.signal(signal.SIGINT, lambda *args: stopping.append(True))
+    for pub in publications:
+        server.log('serving %s, %d bytes in %d segments' % (
+            uri_from_name(pub.components), len(pub.data), pub.count))
+    sys.stdout.write('%s\n' % options['socket'])
+    sys.stdout.flush()
+    try:
+        server.run(until=lambda: stopping)
+    finally:
+        server.close()
+    server.log('%d Interests, %d answered' % (server.interests,
+                                              server.answered))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))